@@ -28,6 +28,11 @@ int screenHeight = 960;
 float spriteScale = 80;
 float period = 4;
 
+// the spirals are updated in fixed steps of this many seconds
+constexpr float TIMESTEP = 1.0f / 120;
+// steps per frame at most, the rest of a long frame is dropped
+constexpr int MAX_STEPS = 8;
+
 enum class DisplayMode : int
 {
     ARCHIMEDES,
@@ -186,6 +191,7 @@ int main()
 
     GLfloat deltaTime = 0.0f;
     GLfloat lastFrame = 0.0f;
+    GLfloat accumulator = 0.0f;
 
     glm::mat4 view = glm::lookAt(glm::vec3{0, 0, 10}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
 
@@ -220,19 +226,28 @@ int main()
         shaderProgram->Use();
         glUniformMatrix4fv(glGetUniformLocation(shaderProgram->Program(), "pv"), 1, GL_FALSE, glm::value_ptr(projection * view));
 
-        archi.Update(deltaTime);
-        logar.Update(deltaTime);
-        ferma.Update(deltaTime);
+        accumulator += deltaTime;
+        for (int steps = 0; accumulator >= TIMESTEP && steps < MAX_STEPS; steps++) {
+            archi.Update(TIMESTEP);
+            logar.Update(TIMESTEP);
+            ferma.Update(TIMESTEP);
+            accumulator -= TIMESTEP;
+        }
+        if (accumulator >= TIMESTEP) {
+            accumulator = fmod(accumulator, TIMESTEP);
+        }
+        // draw in between the last two steps
+        const float blend = accumulator / TIMESTEP;
 
         switch (currentMode) {
         case DisplayMode::ARCHIMEDES:
-            archi.Draw(*shaderProgram, VAO, texture);
+            archi.Draw(*shaderProgram, VAO, texture, blend);
             break;
         case DisplayMode::FERMAT:
-            ferma.Draw(*shaderProgram, VAO, texture);
+            ferma.Draw(*shaderProgram, VAO, texture, blend);
             break;
         case DisplayMode::LOGARITHMIC:
-            logar.Draw(*shaderProgram, VAO, texture);
+            logar.Draw(*shaderProgram, VAO, texture, blend);
             break;
         default:
             break;
@@ -28,6 +28,10 @@ public:
 	glm::vec3 position;
 	glm::vec4 color;
 
+	// state before the last update, for drawing in between two updates
+	glm::vec3 prevPosition;
+	float prevAlpha;
+
 	Particle(float offset, float rad, float life):
 		speed{0}
 	{
@@ -52,10 +56,16 @@ public:
 		));
 
 		position = offset * direction;
+
+		prevPosition = position;
+		prevAlpha = color.a;
 	}
 
 	virtual void Update(float dt)
 	{
+		prevPosition = position;
+		prevAlpha = color.a;
+
 		position += speed * GLfloat(dt);
 		color.a -= fadeSpeed * dt;
 		if (color.a < 0) {
@@ -141,20 +151,24 @@ public:
 		}
 	}
 
-	virtual void Draw(const Shader& shader, GLuint VAO, GLuint texture) const
+	// Draws the particles in between their previous (blend = 0) and current (blend = 1) state.
+	virtual void Draw(const Shader& shader, GLuint VAO, GLuint texture, float blend = 1.0f) const
 	{
 		for (auto& mass : emitted) {
-			drawMass(mass, shader, VAO, texture);
+			drawMass(mass, shader, VAO, texture, blend);
 		}
 	}
 
 protected:
 	virtual Particle* newMass() = 0;
 
-	void drawMass(const Particle* mass, const Shader& shader, GLuint VAO, GLuint texture) const
+	void drawMass(const Particle* mass, const Shader& shader, GLuint VAO, GLuint texture, float blend) const
 	{
-		glUniform2fv(glGetUniformLocation(shader.Program(), "offset"), 1, glm::value_ptr(mass->position));
-		glUniform4fv(glGetUniformLocation(shader.Program(), "color"), 1, glm::value_ptr(mass->color));
+		const glm::vec3 position = glm::mix(mass->prevPosition, mass->position, blend);
+		const glm::vec4 color{glm::vec3(mass->color), glm::mix(mass->prevAlpha, mass->color.a, blend)};
+
+		glUniform2fv(glGetUniformLocation(shader.Program(), "offset"), 1, glm::value_ptr(position));
+		glUniform4fv(glGetUniformLocation(shader.Program(), "color"), 1, glm::value_ptr(color));
 		glUniform1f(glGetUniformLocation(shader.Program(), "scale"), spriteScale);
 
 		glBindTexture(GL_TEXTURE_2D, texture);
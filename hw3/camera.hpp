@@ -1,6 +1,7 @@
 #ifndef CG_CAMERA_H_
 #define CG_CAMERA_H_
 
+#include <array>
 #include <vector>
 
 #include <glad/glad.h>
@@ -48,6 +49,31 @@ public:
     glm::vec3 Right() const { return this->right; }
     // Returns the view matrix calculated using Eular Angles and the LookAt Matrix
     glm::mat4 ViewMatrix() const { return glm::lookAt(this->position, this->position + this->front, this->up); }
+    // Returns the rotation part of the view matrix looking at target, i.e. the view of a camera moved to the origin.
+    // Used to compose model-view matrices relative to the camera without large translations in float.
+    glm::mat4 ViewRotation(const glm::vec3& target) const { return glm::lookAt(glm::vec3(0.0f), target - this->position, this->up); }
+
+    // Extracts the frustum planes (left, right, bottom, top, near, far) of projection * view.
+    // Normals point inwards and are normalized, so dot(plane.xyz, p) + plane.w is the signed distance of p.
+    // The projection must use the OpenGL [-1, 1] depth convention.
+    static std::array<glm::vec4, 6> FrustumPlanes(const glm::mat4& projection, const glm::mat4& view)
+    {
+        const glm::mat4 m = projection * view;
+        const glm::vec4 row0{m[0][0], m[1][0], m[2][0], m[3][0]};
+        const glm::vec4 row1{m[0][1], m[1][1], m[2][1], m[3][1]};
+        const glm::vec4 row2{m[0][2], m[1][2], m[2][2], m[3][2]};
+        const glm::vec4 row3{m[0][3], m[1][3], m[2][3], m[3][3]};
+
+        std::array<glm::vec4, 6> planes{
+            row3 + row0, row3 - row0,
+            row3 + row1, row3 - row1,
+            row3 + row2, row3 - row2
+        };
+        for (auto& p : planes) {
+            p /= glm::length(glm::vec3(p));
+        }
+        return planes;
+    }
 
     /* Setters */
     void SetSpeed(GLfloat newSpeed) { this->movementSpeed = newSpeed; }
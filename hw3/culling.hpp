@@ -0,0 +1,107 @@
+#ifndef CG_CULLING_H_
+#define CG_CULLING_H_
+
+#include <array>
+#include <vector>
+
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+namespace cg
+{
+
+/* Bounding spheres stored as separate arrays, so that the frustum test runs on
+ * 8 (AVX) or 4 (SSE) spheres at a time.
+*/
+class BoundingSpheres
+{
+public:
+    std::vector<float> x, y, z, radius;
+    std::vector<unsigned char> visible;
+
+    void Resize(int n)
+    {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        radius.resize(n);
+        visible.resize(n);
+    }
+
+    int Size() const { return int(x.size()); }
+
+    void Set(int idx, const glm::vec3& center, float r)
+    {
+        x[idx] = center.x;
+        y[idx] = center.y;
+        z[idx] = center.z;
+        radius[idx] = r;
+    }
+
+    bool Visible(int idx) const { return visible[idx] != 0; }
+
+    // Tests all spheres against the frustum planes (see Camera::FrustumPlanes), returns the number of visible ones.
+    // A sphere is culled when it lies entirely behind one of the planes.
+    int Cull(const std::array<glm::vec4, 6>& planes)
+    {
+        const int n = Size();
+        int i = 0;
+#ifdef __AVX__
+        for (; i + 8 <= n; i += 8) {
+            const __m256 px = _mm256_loadu_ps(&x[i]);
+            const __m256 py = _mm256_loadu_ps(&y[i]);
+            const __m256 pz = _mm256_loadu_ps(&z[i]);
+            const __m256 nr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const auto& p : planes) {
+                __m256 d = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(p.x)), _mm256_set1_ps(p.w));
+                d = _mm256_add_ps(d, _mm256_mul_ps(py, _mm256_set1_ps(p.y)));
+                d = _mm256_add_ps(d, _mm256_mul_ps(pz, _mm256_set1_ps(p.z)));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, nr, _CMP_GE_OQ));
+            }
+            const int mask = _mm256_movemask_ps(inside);
+            for (int k = 0; k < 8; k++) {
+                visible[i + k] = (mask >> k) & 1;
+            }
+        }
+#endif
+        for (; i + 4 <= n; i += 4) {
+            const __m128 px = _mm_loadu_ps(&x[i]);
+            const __m128 py = _mm_loadu_ps(&y[i]);
+            const __m128 pz = _mm_loadu_ps(&z[i]);
+            const __m128 nr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+            __m128 inside = _mm_cmpeq_ps(px, px);
+            for (const auto& p : planes) {
+                __m128 d = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(p.x)), _mm_set1_ps(p.w));
+                d = _mm_add_ps(d, _mm_mul_ps(py, _mm_set1_ps(p.y)));
+                d = _mm_add_ps(d, _mm_mul_ps(pz, _mm_set1_ps(p.z)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, nr));
+            }
+            const int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++) {
+                visible[i + k] = (mask >> k) & 1;
+            }
+        }
+        for (; i < n; i++) {
+            bool inside = true;
+            for (const auto& p : planes) {
+                inside = inside && (p.x * x[i] + p.y * y[i] + p.z * z[i] + p.w >= -radius[i]);
+            }
+            visible[i] = inside;
+        }
+
+        int count = 0;
+        for (int k = 0; k < n; k++) {
+            count += visible[k];
+        }
+        return count;
+    }
+};
+
+} /* namespace cg */
+
+#endif /* CG_CULLING_H_ */
@@ -0,0 +1,10 @@
+/*
+ * GLSL Fragment Shader code for OpenGL version 3.3
+ */
+
+#version 330 core
+
+// depth pre-pass: only depth is written, color writes are masked off
+void main()
+{
+}
@@ -4,6 +4,10 @@
 #include <iostream>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -21,6 +25,10 @@
 #include "shader.hpp"
 #include "text.hpp"
 #include "sphere.hpp"
+#include "orbit.hpp"
+#include "nbody.hpp"
+#include "target.hpp"
+#include "culling.hpp"
 
 using namespace cg;
 
@@ -33,6 +41,12 @@ GLfloat speed = 0.5f;
 bool showNames = true;
 bool showText = true;
 bool englFont = false;
+bool gravityMode = false;
+bool gravityReset = false;
+bool depthPrepass = true;
+
+constexpr const GLfloat NEAR_PLANE = 10.0f;
+constexpr const GLfloat FAR_PLANE = 20000.0f;
 
 
 // normalized coordinates
@@ -95,26 +109,47 @@ constexpr const float PLANET_SPEED[] = {
     800
 };
 
-constexpr const float TEXT_Y[] = {
-    130,
-    50,
-    -60,
-    70,
-    -70,
-    90,
-    70,
-    70,
-    70,
-    -50
+GLuint textures[10]{0};
+
+constexpr const int PLANET_PARENT[] = {
+    -1,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    3
 };
 
-GLuint textures[10]{0};
+// masses relative to the sun, only used in gravity mode
+constexpr const double PLANET_MASS[] = {
+    1.0,
+    1e-5,
+    1e-4,
+    5e-2,
+    1e-4,
+    1e-3,
+    3e-4,
+    5e-5,
+    5e-5,
+    1e-5
+};
+
+// asteroid belt between Mars and Jupiter in gravity mode
+constexpr const int NUM_ASTEROIDS = 5000;
+constexpr const float ASTEROID_RADIUS = 0.25f;
+constexpr const double ASTEROID_ORB_MIN = 62;
+constexpr const double ASTEROID_ORB_MAX = 74;
 
-std::array<glm::vec3, 10> positions;
+std::vector<glm::dvec3> positions;
 std::array<GLfloat, 10> angles{0.0f};
+double simTime = 0.0;
 std::array<glm::vec4, 10> textPos;
 
-Camera camera({0, 0, 100}, {0, 0, -1}, 20);
+Camera camera({0, 600, 2400}, {0, 0, -1}, 20);
 
 GLfloat sizeFactor = 5;
 
@@ -127,14 +162,24 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void moveCamera(GLfloat deltaTime);
+void initGravity(NBodySystem& system, const OrbitTree& orbits);
+glm::mat4 reverseDepth(const glm::mat4& projection);
+glm::mat4 relativeModelView(const glm::mat4& viewRotation, const glm::dvec3& eye, const glm::dvec3& position, const glm::mat4& local);
+void benchOrbits(const OrbitTree& orbits);
+void benchGravity();
+void benchCulling();
+void benchJitter(const Shader& program, const Sphere& sphere, GLuint texture, bool reverseZ);
+void benchPrepass(const Shader& depthProgram, const Shader& program, const std::vector<Sphere>& planets, const OrbitTree& orbits, bool reverseZ);
+double elapsedMs(std::chrono::steady_clock::time_point start);
 
 char Upper(const char& c) { return char(c - 32); }
 void releaseTextures() { glDeleteTextures(10, textures); }
 
-glm::vec3 rotateAround(glm::vec3 position, glm::vec3 origin, GLfloat angle);
-
-int main()
+int main(int argc, char* argv[])
 {
+    // with --bench, run the benchmarks in a hidden window and exit
+    const bool benchmark = argc > 1 && std::string(argv[1]) == "--bench";
+
 	// Setup a GLFW window
 
 	// init GLFW, set GL version & pipeline info
@@ -142,6 +187,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, benchmark ? GLFW_FALSE : GLFW_TRUE);
 
 	// create a window
 	GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Yifei Li - Assignment 3", nullptr, nullptr);
@@ -175,6 +221,9 @@ int main()
     // Setup OpenGL options
     glEnable(GL_DEPTH_TEST);
 
+    // reverse-Z needs glClipControl (OpenGL 4.5) to keep the [0, 1] depth range exact
+    const bool reverseZ = GLAD_GL_VERSION_4_5 != 0;
+
 	// ---------------------------------------------------------------
 
 
@@ -186,6 +235,13 @@ int main()
 		return -3;
 	}
 
+    auto depthProgram = Shader::Create("sphere.vert", "depth.frag");
+    if (depthProgram == nullptr) {
+        std::cerr << "Error creating Shader Program" << std::endl;
+        glfwTerminate();
+        return -3;
+    }
+
     Text arial;
     if (!arial.LoadFont("arial.ttf")) {
         std::cerr << "Error loading font '" << "arial.ttf" << "'" << std::endl;
@@ -234,6 +290,26 @@ int main()
         planets.emplace_back(PLANET_RADIA[i] * sizeFactor, unitSphere);
     }
 
+    const Sphere asteroid(ASTEROID_RADIUS * sizeFactor, 8, 8);
+
+    BoundingSpheres bounds;
+    std::vector<int> visibleBodies;
+    std::vector<glm::mat4> bodyTransforms;
+
+    // count fragment shader invocations of the textured pass (core since OpenGL 4.6)
+    GLuint fragmentQuery = 0;
+    bool queryPending = false;
+    GLuint64 fragmentInvocations = 0;
+    if (GLAD_GL_VERSION_4_6) {
+        glGenQueries(1, &fragmentQuery);
+    }
+
+    // the scene is drawn into a float depth buffer when reverse-Z is available
+    std::unique_ptr<RenderTarget> sceneTarget;
+    if (reverseZ) {
+        sceneTarget.reset(new RenderTarget(screenWidth, screenHeight));
+    }
+
 	// ---------------------------------------------------------------
 
 	// Define the viewport dimensions
@@ -243,15 +319,24 @@ int main()
     GLfloat deltaTime = 0.0f;    // Time between current frame and last frame
     GLfloat lastFrame = 0.0f;    // Time of last frame
 
-    // init positions
+    // init orbits, PLANET_SPEED is in degrees per second at full speed
+    OrbitTree orbits;
     for (int i = 0; i < 10; i++) {
-        if (i == 0) {
-            positions[i] = glm::vec3{PLANET_ORB[i] * sizeFactor, 0, 0};
-        } else if (i == 9) {
-            positions[9] = glm::vec3{PLANET_ORB[i] * sizeFactor, 0, 0};
-        } else {
-            positions[i] = glm::vec3{PLANET_ORB[i] * sizeFactor, 0, 0};
-        }
+        orbits.AddBody(OrbitElements(PLANET_ORB[i] * sizeFactor, 0.0, 360.0 / PLANET_SPEED[i]), PLANET_PARENT[i]);
+    }
+
+    // gravity mode, G = 1 and masses are chosen in initGravity
+    NBodySystem nbody(1.0, 0.5, 0.6, 1.0 / 120);
+
+    if (benchmark) {
+        benchOrbits(orbits);
+        benchGravity();
+        benchCulling();
+        benchJitter(*shaderProgram, planets[3], textures[3], reverseZ);
+        benchPrepass(*depthProgram, *shaderProgram, planets, orbits, reverseZ);
+        releaseTextures();
+        glfwTerminate();
+        return 0;
     }
 
 	while (glfwWindowShouldClose(window) == 0) {
@@ -266,7 +351,30 @@ int main()
         moveCamera(deltaTime);
 
 		/* your update code here */
+        simTime += double(deltaTime) * speed;
+        if (gravityReset) {
+            orbits.Evaluate(simTime, positions);
+            if (gravityMode) {
+                initGravity(nbody, orbits);
+            }
+            gravityReset = false;
+        }
+
+        if (gravityMode) {
+            nbody.Advance(double(deltaTime) * speed);
+            std::copy(nbody.Positions().begin(), nbody.Positions().begin() + 10, positions.begin());
+        } else {
+            orbits.Evaluate(simTime, positions);
+        }
 	
+        if (reverseZ) {
+            sceneTarget->Resize(screenWidth, screenHeight);
+            sceneTarget->Bind();
+            glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+            glClearDepth(0.0);
+            glDepthFunc(GL_GREATER);
+        }
+
 		// draw background
 		GLfloat red = 0.1f;
 		GLfloat green = 0.1f;
@@ -276,8 +384,9 @@ int main()
 
         auto screenOrigin = glm::vec2{-static_cast<GLfloat>(screenWidth) / 2, -static_cast<GLfloat>(screenHeight) / 2};
 
-		shaderProgram->Use();
-        glm::mat4 view = glm::lookAt(camera.Position(), {0.0f, 0.0f, 0.0f}, camera.Up());
+        // world positions are in double, models are composed relative to the camera before going to float
+        const glm::dvec3 eye(camera.Position());
+        glm::mat4 viewRotation = camera.ViewRotation({0.0f, 0.0f, 0.0f});
         glm::mat4 UIprojection = glm::ortho(
             screenOrigin.x,
             screenOrigin.x + screenWidth,
@@ -285,44 +394,118 @@ int main()
             screenOrigin.y + screenHeight,
             -5000.0f, 5000.0f
         );
+        glm::mat4 perspective = glm::perspective(glm::radians(camera.Zoom()), GLfloat(screenWidth) / GLfloat(screenHeight), NEAR_PLANE, FAR_PLANE);
+        glm::mat4 projection = reverseZ ? reverseDepth(perspective) : perspective;
+
+        // frustum culling in camera-relative space, bodies out of view get neither mesh nor label
+        const int numBodies = gravityMode ? nbody.Size() : 10;
+        bounds.Resize(numBodies);
+        for (int i = 0; i < numBodies; i++) {
+            if (i < 10) {
+                bounds.Set(i, glm::vec3(positions[i] - eye), planets[i].Radius());
+            } else {
+                bounds.Set(i, glm::vec3(nbody.Positions()[i] - eye), asteroid.Radius());
+            }
+        }
+        bounds.Cull(Camera::FrustumPlanes(perspective, viewRotation));
 
-        for (int i = 0; i < 10; i++) {
-            positions[i] = rotateAround(positions[i], glm::vec3(0.0f), deltaTime * PLANET_SPEED[i] * speed);
-            angles[i] = fmod(angles[i] + deltaTime * PLANET_RADIA[i] * 50 * speed, 360);
-
-            glm::mat4 model = planets[i].Model();
+        visibleBodies.clear();
+        bodyTransforms.clear();
+        for (int i = 0; i < numBodies; i++) {
+            if (i < 10) {
+                angles[i] = GLfloat(fmod(simTime * PLANET_RADIA[i] * 50, 360.0));
+            }
+            if (!bounds.Visible(i)) {
+                continue;
+            }
 
-            if (i < 9) {
-                model = glm::translate(glm::mat4(1.0f), positions[i]) * glm::rotate(glm::mat4(1.0f), glm::radians(angles[i]), {0,1,0}) * model;
+            glm::mat4 model;
+            if (i < 10) {
+                model = glm::rotate(glm::mat4(1.0f), glm::radians(angles[i]), {0,1,0}) * planets[i].Model();
+                model = relativeModelView(viewRotation, eye, positions[i], model);
             } else {
-                model = glm::translate(glm::mat4(1.0f), positions[i] + positions[3]) * glm::rotate(glm::mat4(1.0f), glm::radians(angles[i]), {0,1,0}) * model;
+                model = relativeModelView(viewRotation, eye, nbody.Positions()[i], asteroid.Model());
             }
+            visibleBodies.push_back(i);
+            bodyTransforms.push_back(projection * model);
+        }
 
-            auto pvm = UIprojection * view * model;
+        if (depthPrepass) {
+            // lay down depth first, so the textured pass below shades every pixel only once
+            depthProgram->Use();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (size_t k = 0; k < visibleBodies.size(); k++) {
+                const int i = visibleBodies[k];
+                glUniformMatrix4fv(glGetUniformLocation(depthProgram->Program(), "pvm"), 1, GL_FALSE, glm::value_ptr(bodyTransforms[k]));
+                (i < 10 ? planets[i] : asteroid).Draw();
+            }
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_EQUAL);
+        }
 
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram->Program(), "pvm"), 1, GL_FALSE, glm::value_ptr(pvm));
+        if (fragmentQuery != 0) {
+            if (queryPending) {
+                glGetQueryObjectui64v(fragmentQuery, GL_QUERY_RESULT, &fragmentInvocations);
+            }
+            glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, fragmentQuery);
+        }
 
-            glBindTexture(GL_TEXTURE_2D, textures[i]);
+		shaderProgram->Use();
+        for (size_t k = 0; k < visibleBodies.size(); k++) {
+            const int i = visibleBodies[k];
+            glUniformMatrix4fv(glGetUniformLocation(shaderProgram->Program(), "pvm"), 1, GL_FALSE, glm::value_ptr(bodyTransforms[k]));
 
-            planets[i].Draw();
+            // asteroids share the texture of the moon
+            glBindTexture(GL_TEXTURE_2D, textures[i < 10 ? i : 9]);
+
+            (i < 10 ? planets[i] : asteroid).Draw();
 
             glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        if (fragmentQuery != 0) {
+            glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+            queryPending = true;
+        }
 
+        if (depthPrepass) {
+            glDepthMask(GL_TRUE);
+            glDepthFunc(reverseZ ? GL_GREATER : GL_LESS);
+        }
+
+        if (reverseZ) {
+            sceneTarget->BlitToScreen();
+            glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+            glClearDepth(1.0);
+            glDepthFunc(GL_LESS);
+            glClear(GL_DEPTH_BUFFER_BIT);
         }
 
         const Text& text = englFont ? oldengl : arial;
 
         if (showNames) {
             for (int i = 0; i < 10; i++) {
-                const auto& pos = i < 9 ? positions[i] : positions[i] + positions[3];
-                auto textPos = view * glm::vec4{pos.x, pos.y, pos.z, 1.0f};
+                if (!bounds.Visible(i)) {
+                    continue;
+                }
+                const auto pos = glm::vec3(positions[i] - eye);
+                auto textPos = perspective * viewRotation * glm::vec4{pos.x, pos.y, pos.z, 1.0f};
+                // put the name just above the projected planet
+                auto x = textPos.x / textPos.w * GLfloat(screenWidth) / 2;
+                auto y = (textPos.y + planets[i].Radius() * perspective[1][1]) / textPos.w * GLfloat(screenHeight) / 2;
                 auto name = std::string(PLANET_NAMES[i]);
                 name[0] = Upper(name[0]);
-                text.RenderText(name, textPos.x - 30.0f, TEXT_Y[i], 0.5f, UIprojection, glm::vec3{0.6f, 0.9f, 0.6f});
+                text.RenderText(name, x - 30.0f, y + 10.0f, 0.5f, UIprojection, glm::vec3{0.6f, 0.9f, 0.6f});
             }
         }
 
         if (showText) {
+            if (fragmentQuery != 0) {
+                arial.RenderText(std::string("Fragment shader invocations: ") + std::to_string(fragmentInvocations) + ".", screenOrigin.x + 25, screenOrigin.y + 265, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            }
+            arial.RenderText(depthPrepass ? "Press P to turn off the depth pre-pass." : "Press P to turn on the depth pre-pass.", screenOrigin.x + 25, screenOrigin.y + 235, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(gravityMode ? "Press G to switch back to Kepler orbits." : "Press G to switch to N-body gravity.", screenOrigin.x + 25, screenOrigin.y + 205, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
             arial.RenderText("Use A/D to rotate the camera around the Sun.", screenOrigin.x + 25, screenOrigin.y + 175, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
             arial.RenderText("Use <-/-> ARROW keys to speed down/up.", screenOrigin.x + 25, screenOrigin.y + 145, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
             arial.RenderText(std::string("Current speed is ") + std::to_string(speed) + ".", screenOrigin.x + 25, screenOrigin.y + 115, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
@@ -337,6 +520,9 @@ int main()
 
 	// properly de-allocate all resources
     releaseTextures();
+    if (fragmentQuery != 0) {
+        glDeleteQueries(1, &fragmentQuery);
+    }
 
 	glfwTerminate();
 	return 0;
@@ -355,6 +541,11 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
         showText = !showText;
     } else if (key == GLFW_KEY_F && action == GLFW_PRESS) {
         englFont = !englFont;
+    } else if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        depthPrepass = !depthPrepass;
+    } else if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        gravityMode = !gravityMode;
+        gravityReset = true;
     } else if (key == GLFW_KEY_RIGHT && action == GLFW_PRESS) {
         auto res = speed + 0.1;
         if (res > 1) {
@@ -413,9 +604,354 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, screenWidth, screenHeight);
 }
 
-glm::vec3 rotateAround(glm::vec3 position, glm::vec3 origin, GLfloat angle)
+void initGravity(NBodySystem& system, const OrbitTree& orbits)
 {
-    auto toward = position - origin;
-    auto res = glm::rotate(glm::mat4(1.0f), glm::radians(angle), {0, 1, 0}) * glm::vec4{toward.x, toward.y, toward.z, 1.0f};
-    return origin + glm::vec3{res.x, res.y, res.z};
+    // pick the solar mass so that the Earth keeps its period
+    const double earthOmega = 2 * OrbitTree::PI / orbits.Elements(3).period;
+    const double earthOrb = orbits.Elements(3).semiMajorAxis;
+    const double sunMass = earthOmega * earthOmega * earthOrb * earthOrb * earthOrb;
+
+    system.Clear();
+
+    // start every body on a circular orbit around its parent
+    std::vector<glm::dvec3> velocities(10, glm::dvec3(0.0));
+    for (int i = 0; i < 10; i++) {
+        const int parent = PLANET_PARENT[i];
+        if (parent >= 0) {
+            const glm::dvec3 rel = positions[i] - positions[parent];
+            const double r = glm::length(rel);
+            const double v = sqrt((PLANET_MASS[parent] + PLANET_MASS[i]) * sunMass / r);
+            velocities[i] = velocities[parent] + v * glm::normalize(glm::cross(glm::dvec3{0, 1, 0}, rel));
+        }
+        system.AddBody(PLANET_MASS[i] * sunMass, positions[i], velocities[i]);
+    }
+
+    // massless asteroids
+    std::mt19937 rng(2021);
+    std::uniform_real_distribution<double> orb(ASTEROID_ORB_MIN * sizeFactor, ASTEROID_ORB_MAX * sizeFactor);
+    std::uniform_real_distribution<double> angle(0, 2 * OrbitTree::PI);
+    std::uniform_real_distribution<double> height(-sizeFactor, double(sizeFactor));
+    for (int i = 0; i < NUM_ASTEROIDS; i++) {
+        const double r = orb(rng);
+        const double a = angle(rng);
+        const glm::dvec3 pos{r * cos(a), height(rng), -r * sin(a)};
+        const double v = sqrt(sunMass / r);
+        system.AddBody(0.0, pos, v * glm::dvec3{-sin(a), 0, -cos(a)});
+    }
+}
+
+glm::mat4 reverseDepth(const glm::mat4& projection)
+{
+    // remap NDC depth from [-1 (near), 1 (far)] to [1 (near), 0 (far)]
+    glm::mat4 remap(1.0f);
+    remap[2][2] = -0.5f;
+    remap[3][2] = 0.5f;
+    return remap * projection;
+}
+
+glm::mat4 relativeModelView(const glm::mat4& viewRotation, const glm::dvec3& eye, const glm::dvec3& position, const glm::mat4& local)
+{
+    // the large world coordinates cancel out in double, only the small camera-relative offset goes to float
+    const glm::vec3 offset(position - eye);
+    return viewRotation * glm::translate(glm::mat4(1.0f), offset) * local;
+}
+
+/* ======================== benchmarks (--bench) ======================== */
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchOrbits(const OrbitTree& orbits)
+{
+    // throughput on a large hierarchy: 1000 planets with 99 moons each
+    OrbitTree tree;
+    std::mt19937 rng(26);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (int i = 0; i < 1000; i++) {
+        const int planet = tree.AddBody(OrbitElements(100 + 1000 * unit(rng), 0.3 * unit(rng), 10 + 100 * unit(rng),
+                                                      OrbitTree::TWO_PI * unit(rng), 0.1 * unit(rng)));
+        for (int k = 0; k < 99; k++) {
+            tree.AddBody(OrbitElements(1 + 10 * unit(rng), 0.5 * unit(rng), 1 + unit(rng),
+                                       OrbitTree::TWO_PI * unit(rng), unit(rng), OrbitTree::TWO_PI * unit(rng)), planet);
+        }
+    }
+    std::vector<glm::dvec3> result;
+    const int frames = 50;
+    const auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        tree.Evaluate(f / 60.0, result);
+    }
+    const double ms = elapsedMs(start);
+    std::cout << "orbits: " << tree.Size() << " bodies, " << ms / frames << " ms per evaluation, "
+              << tree.Size() * frames / ms * 1e-3 << " M bodies/s" << std::endl;
+
+    // drift: after whole periods every body must be back where it started, relative to its parent
+    for (double revolutions : {1.0, 1e3, 1e6}) {
+        double drift = 0.0;
+        std::vector<glm::dvec3> first, later;
+        for (int i = 1; i < orbits.Size(); i++) {
+            const double t0 = 12.34;
+            orbits.Evaluate(t0, first);
+            orbits.Evaluate(t0 + revolutions * orbits.Elements(i).period, later);
+            const int parent = orbits.Parent(i);
+            const glm::dvec3 a = first[i] - first[parent];
+            const glm::dvec3 b = later[i] - later[parent];
+            drift = std::max(drift, glm::length(b - a) / orbits.Elements(i).semiMajorAxis);
+        }
+        std::cout << "orbits: drift after " << revolutions << " revolutions " << drift << " of the orbit radius" << std::endl;
+    }
+}
+
+void benchGravity()
+{
+    // a heavy center with a disc of light bodies around it, like the solar system in gravity mode
+    auto makeDisc = [](NBodySystem& system, int n) {
+        std::mt19937 rng(27);
+        std::uniform_real_distribution<double> orb(50, 1000);
+        std::uniform_real_distribution<double> angle(0, 2 * OrbitTree::PI);
+        std::uniform_real_distribution<double> height(-10, 10);
+        system.AddBody(1e6, glm::dvec3(0.0), glm::dvec3(0.0));
+        for (int i = 1; i < n; i++) {
+            const double r = orb(rng);
+            const double a = angle(rng);
+            const double v = sqrt(1e6 / r);
+            system.AddBody(1.0, {r * cos(a), height(rng), -r * sin(a)}, v * glm::dvec3{-sin(a), 0, -cos(a)});
+        }
+    };
+
+    // accuracy of the Barnes-Hut accelerations against direct summation
+    for (int n : {1000, 10000}) {
+        NBodySystem system(1.0, 0.5, 0.6, 1.0 / 120);
+        makeDisc(system, n);
+        std::vector<glm::dvec3> approx, exact;
+        auto start = std::chrono::steady_clock::now();
+        system.ComputeAccelerations(approx);
+        const double treeMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        system.ComputeAccelerationsDirect(exact);
+        const double directMs = elapsedMs(start);
+
+        double sum = 0.0, worst = 0.0;
+        for (int i = 0; i < n; i++) {
+            const double err = glm::length(approx[i] - exact[i]) / glm::length(exact[i]);
+            sum += err;
+            worst = std::max(worst, err);
+        }
+        std::cout << "gravity: " << n << " bodies, theta " << system.Theta() << ", relative error mean " << sum / n
+                  << " max " << worst << ", Barnes-Hut " << treeMs << " ms, direct " << directMs << " ms" << std::endl;
+    }
+
+    // scaling of full steps with the number of threads
+    const int hardware = std::max(1, int(std::thread::hardware_concurrency()));
+    NBodySystem system(1.0, 0.5, 0.6, 1.0 / 120);
+    makeDisc(system, 100000);
+    system.Step();
+    for (int threads = 1; ; threads = std::min(2 * threads, hardware)) {
+        system.SetThreads(threads);
+        const int steps = 5;
+        const auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < steps; k++) {
+            system.Step();
+        }
+        std::cout << "gravity: " << system.Size() << " bodies, " << threads << " threads, "
+                  << elapsedMs(start) / steps << " ms per step" << std::endl;
+        if (threads == hardware) {
+            break;
+        }
+    }
+}
+
+void benchJitter(const Shader& program, const Sphere& sphere, GLuint texture, bool reverseZ)
+{
+    // the same view of a planet near the origin and far away from it must give the same image
+    const int size = 256;
+    RenderTarget target(size, size);
+    const glm::mat4 perspective = glm::perspective(glm::radians(45.0f), 1.0f, NEAR_PLANE, FAR_PLANE);
+    const glm::mat4 projection = reverseZ ? reverseDepth(perspective) : perspective;
+    const glm::dvec3 toEye{30, 20, 80};
+
+    auto render = [&](const glm::dvec3& origin, bool relative) {
+        const glm::dvec3 position = origin;
+        const glm::dvec3 eye = origin + toEye;
+        glm::mat4 model;
+        if (relative) {
+            const glm::mat4 viewRotation = glm::lookAt(glm::vec3(0.0f), glm::vec3(-toEye), {0, 1, 0});
+            model = relativeModelView(viewRotation, eye, position, sphere.Model());
+        } else {
+            // everything in float, as before the camera-relative transforms
+            const glm::mat4 view = glm::lookAt(glm::vec3(eye), glm::vec3(position), {0, 1, 0});
+            model = view * glm::translate(glm::mat4(1.0f), glm::vec3(position)) * sphere.Model();
+        }
+        const glm::mat4 pvm = projection * model;
+
+        target.Bind();
+        glViewport(0, 0, size, size);
+        if (reverseZ) {
+            glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+            glClearDepth(0.0);
+            glDepthFunc(GL_GREATER);
+        }
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        program.Use();
+        glUniformMatrix4fv(glGetUniformLocation(program.Program(), "pvm"), 1, GL_FALSE, glm::value_ptr(pvm));
+        glBindTexture(GL_TEXTURE_2D, texture);
+        sphere.Draw();
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        std::vector<unsigned char> pixels(size * size * 4);
+        glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (reverseZ) {
+            glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+            glClearDepth(1.0);
+            glDepthFunc(GL_LESS);
+        }
+        glViewport(0, 0, screenWidth, screenHeight);
+        return pixels;
+    };
+
+    for (bool relative : {true, false}) {
+        const std::vector<unsigned char> reference = render(glm::dvec3(0.0), relative);
+        for (double distance : {1e4, 1e6, 1e8}) {
+            const std::vector<unsigned char> image = render(glm::dvec3(distance, -0.5 * distance, distance), relative);
+            int differentPixels = 0;
+            for (int i = 0; i < size * size; i++) {
+                differentPixels += !std::equal(&image[4 * i], &image[4 * i + 4], &reference[4 * i]);
+            }
+            std::cout << "jitter: " << (relative ? "camera-relative" : "float view * model") << " at " << distance << ", "
+                      << differentPixels << " of " << size * size << " pixels differ" << std::endl;
+        }
+    }
+}
+
+void benchCulling()
+{
+    // 100k bodies spread over the whole scene around the camera
+    const int n = 100000;
+    std::mt19937 rng(29);
+    std::uniform_real_distribution<float> coord(-FAR_PLANE, FAR_PLANE);
+    std::uniform_real_distribution<float> radius(1.0f, 100.0f);
+    BoundingSpheres bounds;
+    bounds.Resize(n);
+    for (int i = 0; i < n; i++) {
+        bounds.Set(i, {coord(rng), coord(rng), coord(rng)}, radius(rng));
+    }
+    const glm::mat4 perspective = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, NEAR_PLANE, FAR_PLANE);
+    const auto planes = Camera::FrustumPlanes(perspective, glm::lookAt(glm::vec3(0.0f), {0.3f, -0.2f, -1.0f}, {0, 1, 0}));
+
+    const int runs = 100;
+    int visible = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < runs; k++) {
+        visible = bounds.Cull(planes);
+    }
+    const double simdMs = elapsedMs(start) / runs;
+
+    // the same test one sphere and one plane at a time
+    std::vector<unsigned char> scalar(n);
+    start = std::chrono::steady_clock::now();
+    for (int k = 0; k < runs; k++) {
+        for (int i = 0; i < n; i++) {
+            bool inside = true;
+            for (const auto& p : planes) {
+                inside = inside && (p.x * bounds.x[i] + p.y * bounds.y[i] + p.z * bounds.z[i] + p.w >= -bounds.radius[i]);
+            }
+            scalar[i] = inside;
+        }
+    }
+    const double scalarMs = elapsedMs(start) / runs;
+
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+        mismatches += (scalar[i] != 0) != bounds.Visible(i);
+    }
+    std::cout << "culling: " << n << " bodies, " << visible << " visible, " << simdMs << " ms SIMD, "
+              << scalarMs << " ms scalar, " << mismatches << " mismatches" << std::endl;
+}
+
+void benchPrepass(const Shader& depthProgram, const Shader& program, const std::vector<Sphere>& planets, const OrbitTree& orbits, bool reverseZ)
+{
+    // at t = 0 all planets are lined up on +X, look at them from +X so that each one covers the ones drawn before
+    RenderTarget target(screenWidth, screenHeight);
+    const glm::dvec3 eye{1800, 30, 0};
+    const glm::mat4 viewRotation = glm::lookAt(glm::vec3(0.0f), glm::vec3(-eye), {0, 1, 0});
+    const glm::mat4 perspective = glm::perspective(glm::radians(45.0f), GLfloat(screenWidth) / GLfloat(screenHeight), NEAR_PLANE, FAR_PLANE);
+    const glm::mat4 projection = reverseZ ? reverseDepth(perspective) : perspective;
+    std::vector<glm::dvec3> bodies;
+    orbits.Evaluate(0.0, bodies);
+    std::vector<glm::mat4> transforms;
+    for (int i = 0; i < 10; i++) {
+        transforms.push_back(projection * relativeModelView(viewRotation, eye, bodies[i], planets[i].Model()));
+    }
+
+    // samples passing the depth test are what early-Z hardware shades, invocations are counted on OpenGL 4.6
+    GLuint queries[2] = {0, 0};
+    GLuint64 samples = 0, invocations = 0;
+    glGenQueries(GLAD_GL_VERSION_4_6 ? 2 : 1, queries);
+    target.Bind();
+    if (reverseZ) {
+        glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+        glClearDepth(0.0);
+    }
+    auto draw = [&](bool prepass) {
+        glDepthFunc(reverseZ ? GL_GREATER : GL_LESS);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (prepass) {
+            depthProgram.Use();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (int i = 0; i < 10; i++) {
+                glUniformMatrix4fv(glGetUniformLocation(depthProgram.Program(), "pvm"), 1, GL_FALSE, glm::value_ptr(transforms[i]));
+                planets[i].Draw();
+            }
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_EQUAL);
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+        if (queries[1] != 0) {
+            glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, queries[1]);
+        }
+        program.Use();
+        for (int i = 0; i < 10; i++) {
+            glUniformMatrix4fv(glGetUniformLocation(program.Program(), "pvm"), 1, GL_FALSE, glm::value_ptr(transforms[i]));
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            planets[i].Draw();
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glEndQuery(GL_SAMPLES_PASSED);
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &samples);
+        if (queries[1] != 0) {
+            glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+            glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &invocations);
+        }
+        glDepthMask(GL_TRUE);
+    };
+
+    for (bool prepass : {false, true}) {
+        const int frames = 20;
+        draw(prepass);
+        glFinish();
+        const auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < frames; k++) {
+            draw(prepass);
+        }
+        glFinish();
+        std::cout << "pre-pass: " << (prepass ? "on, " : "off, ") << elapsedMs(start) / frames << " ms per frame, "
+                  << samples << " samples passed in the textured pass";
+        if (queries[1] != 0) {
+            std::cout << ", " << invocations << " fragment shader invocations";
+        }
+        std::cout << std::endl;
+    }
+    glDeleteQueries(GLAD_GL_VERSION_4_6 ? 2 : 1, queries);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (reverseZ) {
+        glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+        glClearDepth(1.0);
+    }
+    glDepthFunc(GL_LESS);
 }
@@ -0,0 +1,467 @@
+#ifndef CG_NBODY_H_
+#define CG_NBODY_H_
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "jobs.hpp"
+
+namespace cg
+{
+
+/// A node of the Barnes-Hut octree. Leaves own a range of the Morton-sorted bodies.
+struct OctreeNode
+{
+    glm::dvec3 com;         // center of mass
+    double mass;
+    glm::dvec3 center;      // center of the cell
+    double halfSize;
+    int children[8];        // -1 if the octant is empty
+    int first;              // leaf only: first body in the sorted order
+    int count;              // number of bodies in the cell
+    bool leaf;
+};
+
+/* Gravitational N-body system integrated with a kick-drift-kick leapfrog in fixed steps.
+ *
+ * Forces come from a Barnes-Hut octree that is rebuilt every step: bodies are sorted by their
+ * Morton keys, then the eight octants under the root are built as separate jobs. The tree is
+ * traversed by several threads, each taking a contiguous (and thus spatially coherent) range of
+ * the sorted bodies.
+ *
+ * All parallel passes run on a JobSystem owned by the system, created once by SetThreads(), so no
+ * thread is started during a step. The calling thread works too, it runs jobs while it waits.
+*/
+class NBodySystem
+{
+public:
+    static constexpr int LEAF_SIZE = 8;
+    static constexpr int MAX_LEVEL = 21;    // 21 bits per axis in a 64-bit Morton key
+
+    NBodySystem(double G, double softening = 0.5, double theta = 0.5, double timestep = 1.0 / 240, int numThreads = 0) :
+        G_(G), softening2_(softening * softening), theta_(theta), timestep_(timestep), accumulator_(0), accValid_(false), numThreads_(0)
+    {
+        SetThreads(numThreads);
+    }
+
+    void Clear()
+    {
+        mass_.clear();
+        pos_.clear();
+        vel_.clear();
+        acc_.clear();
+        accumulator_ = 0;
+        accValid_ = false;
+    }
+
+    int AddBody(double mass, const glm::dvec3& position, const glm::dvec3& velocity)
+    {
+        mass_.push_back(mass);
+        pos_.push_back(position);
+        vel_.push_back(velocity);
+        acc_.emplace_back(0.0);
+        accValid_ = false;
+        return int(mass_.size()) - 1;
+    }
+
+    int Size() const { return int(mass_.size()); }
+    double Mass(int idx) const { return mass_[idx]; }
+    const std::vector<glm::dvec3>& Positions() const { return pos_; }
+    const std::vector<glm::dvec3>& Velocities() const { return vel_; }
+    const std::vector<OctreeNode>& Nodes() const { return nodes_; }
+
+    double Timestep() const { return timestep_; }
+    double Theta() const { return theta_; }
+    int Threads() const { return numThreads_; }
+
+    void SetTheta(double theta) { theta_ = theta; }
+    void SetThreads(int numThreads)
+    {
+        if (numThreads <= 0) {
+            numThreads = int(std::thread::hardware_concurrency());
+        }
+        numThreads = numThreads > 0 ? numThreads : 1;
+        if (numThreads == numThreads_) {
+            return;
+        }
+        numThreads_ = numThreads;
+        jobs_.reset(numThreads_ > 1 ? new JobSystem(numThreads_ - 1) : nullptr);
+    }
+
+    // Advances the simulation by dt with fixed steps, the remainder is kept for the next call.
+    // At most maxSteps are taken so that a slow frame cannot stall the program. Returns the number of steps.
+    int Advance(double dt, int maxSteps = 8)
+    {
+        accumulator_ += dt;
+        int steps = 0;
+        while (accumulator_ >= timestep_ && steps < maxSteps) {
+            Step();
+            accumulator_ -= timestep_;
+            steps++;
+        }
+        if (steps == maxSteps && accumulator_ > timestep_) {
+            // drop the time we couldn't keep up with
+            accumulator_ = 0;
+        }
+        return steps;
+    }
+
+    // One kick-drift-kick leapfrog step.
+    void Step()
+    {
+        const double h = timestep_;
+        if (!accValid_) {
+            ComputeAccelerations(acc_);
+            accValid_ = true;
+        }
+        parallelFor(Size(), [&](int lo, int hi) {
+            for (int i = lo; i < hi; i++) {
+                vel_[i] += acc_[i] * (0.5 * h);
+                pos_[i] += vel_[i] * h;
+            }
+        });
+        ComputeAccelerations(acc_);
+        parallelFor(Size(), [&](int lo, int hi) {
+            for (int i = lo; i < hi; i++) {
+                vel_[i] += acc_[i] * (0.5 * h);
+            }
+        });
+    }
+
+    // Barnes-Hut accelerations of all bodies at their current positions.
+    void ComputeAccelerations(std::vector<glm::dvec3>& acc)
+    {
+        acc.resize(Size());
+        if (Size() == 0) {
+            return;
+        }
+        buildTree();
+
+        // split the sorted order so that every thread walks a compact region of space
+        parallelFor(Size(), [&](int lo, int hi) {
+            for (int k = lo; k < hi; k++) {
+                const int i = sorted_[k];
+                acc[i] = accelerationAt(pos_[i], i);
+            }
+        });
+    }
+
+    // Reference O(N^2) accelerations by direct summation.
+    void ComputeAccelerationsDirect(std::vector<glm::dvec3>& acc) const
+    {
+        const int n = Size();
+        acc.assign(n, glm::dvec3(0.0));
+        parallelFor(n, [&](int lo, int hi) {
+            for (int i = lo; i < hi; i++) {
+                glm::dvec3 a(0.0);
+                for (int j = 0; j < n; j++) {
+                    if (j != i) {
+                        a += pairAcceleration(pos_[i], pos_[j], mass_[j]);
+                    }
+                }
+                acc[i] = a;
+            }
+        });
+    }
+
+private:
+    double G_;
+    double softening2_;
+    double theta_;
+    double timestep_;
+    double accumulator_;
+    bool accValid_;
+    int numThreads_;
+    std::unique_ptr<JobSystem> jobs_;   // numThreads_ - 1 workers, none for a single thread
+
+    std::vector<double> mass_;
+    std::vector<glm::dvec3> pos_;
+    std::vector<glm::dvec3> vel_;
+    std::vector<glm::dvec3> acc_;
+
+    // tree state, rebuilt every step
+    std::vector<OctreeNode> nodes_;
+    std::vector<std::pair<uint64_t, int>> keys_;
+    std::vector<int> sorted_;
+
+    // Calls task(t) for every t in [0, count) on the worker pool and waits for all of them.
+    template <typename Func>
+    void runTasks(int count, const Func& task) const
+    {
+        if (!jobs_ || count <= 1) {
+            for (int t = 0; t < count; t++) {
+                task(t);
+            }
+            return;
+        }
+        jobs_->ParallelFor(count, 1, [&task](int begin, int end) {
+            for (int t = begin; t < end; t++) {
+                task(t);
+            }
+        });
+    }
+
+    // Splits [0, n) into one contiguous range per thread and calls func(lo, hi) on each.
+    template <typename Func>
+    void parallelFor(int n, const Func& func) const
+    {
+        const int numChunks = std::min(numThreads_, std::max(1, n / 256));
+        runTasks(numChunks, [&](int t) {
+            func(int(int64_t(n) * t / numChunks), int(int64_t(n) * (t + 1) / numChunks));
+        });
+    }
+
+    glm::dvec3 pairAcceleration(const glm::dvec3& p, const glm::dvec3& q, double m) const
+    {
+        const glm::dvec3 r = q - p;
+        const double d2 = glm::dot(r, r) + softening2_;
+        return r * (G_ * m / (d2 * std::sqrt(d2)));
+    }
+
+    static uint64_t spreadBits(uint64_t v)
+    {
+        // insert two zero bits between each of the lower 21 bits
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    static int octantAt(uint64_t key, int level)
+    {
+        return int(key >> (3 * (MAX_LEVEL - 1 - level))) & 7;
+    }
+
+    void buildTree()
+    {
+        const int n = Size();
+
+        // bounding cube
+        glm::dvec3 lo = pos_[0], hi = pos_[0];
+        for (int i = 1; i < n; i++) {
+            lo = glm::min(lo, pos_[i]);
+            hi = glm::max(hi, pos_[i]);
+        }
+        const glm::dvec3 extent = hi - lo;
+        const double size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-9)) * (1 + 1e-9);
+        const glm::dvec3 center = lo + glm::dvec3(size * 0.5);
+        const double cells = double(1 << MAX_LEVEL);
+
+        // Morton keys
+        keys_.resize(n);
+        parallelFor(n, [&](int b, int e) {
+            for (int i = b; i < e; i++) {
+                const glm::dvec3 q = (pos_[i] - lo) * (cells / size);
+                const uint64_t qx = uint64_t(std::min(std::max(q.x, 0.0), cells - 1));
+                const uint64_t qy = uint64_t(std::min(std::max(q.y, 0.0), cells - 1));
+                const uint64_t qz = uint64_t(std::min(std::max(q.z, 0.0), cells - 1));
+                keys_[i] = {spreadBits(qx) << 2 | spreadBits(qy) << 1 | spreadBits(qz), i};
+            }
+        });
+        sortKeys();
+
+        sorted_.resize(n);
+        for (int i = 0; i < n; i++) {
+            sorted_[i] = keys_[i].second;
+        }
+
+        // the root and its eight octants, each octant subtree built on its own thread
+        nodes_.clear();
+        nodes_.push_back(makeNode(0, n, center, size * 0.5));
+        OctreeNode& root = nodes_[0];
+
+        if (n <= LEAF_SIZE) {
+            finishLeaf(root);
+            return;
+        }
+        root.leaf = false;
+
+        int bounds[9];
+        bounds[0] = 0;
+        for (int oct = 0; oct < 8; oct++) {
+            int end = bounds[oct];
+            while (end < n && octantAt(keys_[end].first, 0) == oct) {
+                end++;
+            }
+            bounds[oct + 1] = end;
+        }
+        std::vector<OctreeNode> subtrees[8];
+        runTasks(8, [&](int oct) {
+            if (bounds[oct + 1] > bounds[oct]) {
+                build(subtrees[oct], bounds[oct], bounds[oct + 1], 1, octantCenter(center, size * 0.5, oct), size * 0.25);
+            }
+        });
+
+        // merge the subtrees behind the root
+        for (int oct = 0; oct < 8; oct++) {
+            if (subtrees[oct].empty()) {
+                nodes_[0].children[oct] = -1;
+                continue;
+            }
+            const int offset = int(nodes_.size());
+            for (OctreeNode node : subtrees[oct]) {
+                for (int& c : node.children) {
+                    if (c >= 0) {
+                        c += offset;
+                    }
+                }
+                nodes_.push_back(node);
+            }
+            nodes_[0].children[oct] = offset;
+        }
+
+        OctreeNode& top = nodes_[0];
+        top.mass = 0;
+        top.com = glm::dvec3(0.0);
+        for (int c : top.children) {
+            if (c >= 0) {
+                top.mass += nodes_[c].mass;
+                top.com += nodes_[c].com * nodes_[c].mass;
+            }
+        }
+        top.com = top.mass > 0 ? top.com / top.mass : top.center;
+    }
+
+    void sortKeys()
+    {
+        // sort chunks in parallel, then merge them pairwise
+        const int n = int(keys_.size());
+        const int numChunks = std::min(numThreads_, std::max(1, n / 4096));
+        std::vector<int> bounds(numChunks + 1);
+        for (int t = 0; t <= numChunks; t++) {
+            bounds[t] = int(int64_t(n) * t / numChunks);
+        }
+        runTasks(numChunks, [&](int t) {
+            std::sort(keys_.begin() + bounds[t], keys_.begin() + bounds[t + 1]);
+        });
+        for (int width = 1; width < numChunks; width *= 2) {
+            // merge chunk t with chunk t + width, for every t that is a multiple of 2 * width
+            runTasks((numChunks - width + 2 * width - 1) / (2 * width), [&](int k) {
+                const int t = 2 * width * k;
+                const int first = bounds[t];
+                const int mid = bounds[t + width];
+                const int last = bounds[std::min(t + 2 * width, numChunks)];
+                std::inplace_merge(keys_.begin() + first, keys_.begin() + mid, keys_.begin() + last);
+            });
+        }
+    }
+
+    OctreeNode makeNode(int first, int count, const glm::dvec3& center, double halfSize) const
+    {
+        OctreeNode node;
+        node.com = glm::dvec3(0.0);
+        node.mass = 0;
+        node.center = center;
+        node.halfSize = halfSize;
+        std::fill(node.children, node.children + 8, -1);
+        node.first = first;
+        node.count = count;
+        node.leaf = true;
+        return node;
+    }
+
+    static glm::dvec3 octantCenter(const glm::dvec3& center, double halfSize, int oct)
+    {
+        const double q = halfSize * 0.5;
+        return center + glm::dvec3((oct & 4) ? q : -q, (oct & 2) ? q : -q, (oct & 1) ? q : -q);
+    }
+
+    void finishLeaf(OctreeNode& node) const
+    {
+        node.leaf = true;
+        node.mass = 0;
+        node.com = glm::dvec3(0.0);
+        for (int k = node.first; k < node.first + node.count; k++) {
+            const int i = sorted_[k];
+            node.mass += mass_[i];
+            node.com += pos_[i] * mass_[i];
+        }
+        node.com = node.mass > 0 ? node.com / node.mass : node.center;
+    }
+
+    // Builds the subtree of the sorted bodies [begin, end) into out, returns the index of its root.
+    int build(std::vector<OctreeNode>& out, int begin, int end, int level, const glm::dvec3& center, double halfSize) const
+    {
+        const int idx = int(out.size());
+        out.push_back(makeNode(begin, end - begin, center, halfSize));
+
+        if (end - begin <= LEAF_SIZE || level >= MAX_LEVEL) {
+            finishLeaf(out[idx]);
+            return idx;
+        }
+
+        int children[8];
+        int b = begin;
+        for (int oct = 0; oct < 8; oct++) {
+            int e = b;
+            while (e < end && octantAt(keys_[e].first, level) == oct) {
+                e++;
+            }
+            children[oct] = e > b ? build(out, b, e, level + 1, octantCenter(center, halfSize, oct), halfSize * 0.5) : -1;
+            b = e;
+        }
+
+        OctreeNode& node = out[idx];
+        node.leaf = false;
+        for (int oct = 0; oct < 8; oct++) {
+            node.children[oct] = children[oct];
+            if (children[oct] >= 0) {
+                node.mass += out[children[oct]].mass;
+                node.com += out[children[oct]].com * out[children[oct]].mass;
+            }
+        }
+        node.com = node.mass > 0 ? node.com / node.mass : node.center;
+        return idx;
+    }
+
+    glm::dvec3 accelerationAt(const glm::dvec3& p, int self) const
+    {
+        const double theta2 = theta_ * theta_;
+        glm::dvec3 a(0.0);
+
+        int stack[8 * MAX_LEVEL + 8];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const OctreeNode& node = nodes_[stack[--top]];
+            if (node.leaf) {
+                for (int k = node.first; k < node.first + node.count; k++) {
+                    const int j = sorted_[k];
+                    if (j != self) {
+                        a += pairAcceleration(p, pos_[j], mass_[j]);
+                    }
+                }
+                continue;
+            }
+
+            const glm::dvec3 r = node.com - p;
+            const double d2 = glm::dot(r, r);
+            const double s = 2 * node.halfSize;
+            if (s * s < theta2 * d2) {
+                // far enough, the whole cell acts as a point mass
+                a += pairAcceleration(p, node.com, node.mass);
+            } else {
+                for (int c : node.children) {
+                    if (c >= 0) {
+                        stack[top++] = c;
+                    }
+                }
+            }
+        }
+        return a;
+    }
+};
+
+} /* namespace cg */
+
+#endif /* CG_NBODY_H_ */
@@ -0,0 +1,137 @@
+#ifndef CG_ORBIT_H_
+#define CG_ORBIT_H_
+
+#include <vector>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace cg
+{
+
+/// Classical Keplerian elements of an orbit relative to its parent body.
+/// Angles are in radians, the period is in (simulation) seconds per revolution.
+struct OrbitElements
+{
+    double semiMajorAxis;   // a
+    double eccentricity;    // e, in [0, 1)
+    double inclination;     // i
+    double ascendingNode;   // longitude of the ascending node
+    double argPeriapsis;    // argument of periapsis
+    double meanAnomaly;     // mean anomaly at t = 0
+    double period;          // orbital period, <= 0 means the body rests at its parent
+
+    OrbitElements(double a = 0.0, double e = 0.0, double period = 0.0, double meanAnomaly = 0.0,
+                  double inclination = 0.0, double ascendingNode = 0.0, double argPeriapsis = 0.0) :
+        semiMajorAxis(a), eccentricity(e), inclination(inclination), ascendingNode(ascendingNode),
+        argPeriapsis(argPeriapsis), meanAnomaly(meanAnomaly), period(period) { }
+};
+
+/* A hierarchy of Keplerian orbits. Every body orbits its parent (or the origin for roots),
+ * and positions are evaluated directly from the time, so nothing is accumulated frame by frame.
+ *
+ * The reference plane is the XZ plane with +Y as its north pole, and a prograde orbit moves
+ * from +X towards -Z, i.e. the same direction as a positive rotation around +Y.
+*/
+class OrbitTree
+{
+public:
+    static constexpr double PI = 3.14159265358979323846;
+    static constexpr double TWO_PI = 2 * PI;
+    // Newton steps for Kepler's equation, enough for e < 0.9 in double precision
+    static constexpr int KEPLER_ITERATIONS = 8;
+
+    // Adds a body and returns its index. A parent must be added before its children.
+    int AddBody(const OrbitElements& elements, int parent = -1)
+    {
+        const double cosO = cos(elements.ascendingNode), sinO = sin(elements.ascendingNode);
+        const double cosw = cos(elements.argPeriapsis), sinw = sin(elements.argPeriapsis);
+        const double cosi = cos(elements.inclination), sini = sin(elements.inclination);
+
+        // perifocal basis in ecliptic (x, y, z = north) coordinates
+        glm::dvec3 P{cosO * cosw - sinO * sinw * cosi, sinO * cosw + cosO * sinw * cosi, sinw * sini};
+        glm::dvec3 Q{-cosO * sinw - sinO * cosw * cosi, -sinO * sinw + cosO * cosw * cosi, cosw * sini};
+
+        const double a = elements.semiMajorAxis;
+        const double e = elements.eccentricity;
+        const double b = a * sqrt(1.0 - e * e);
+
+        // ecliptic (x, y, z) -> world (x, z, -y), pre-scaled by the semi-axes
+        px_.push_back(a * P.x);
+        py_.push_back(a * P.z);
+        pz_.push_back(-a * P.y);
+        qx_.push_back(b * Q.x);
+        qy_.push_back(b * Q.z);
+        qz_.push_back(-b * Q.y);
+
+        ecc_.push_back(e);
+        meanMotion_.push_back(elements.period > 0 ? TWO_PI / elements.period : 0.0);
+        meanAnomaly_.push_back(elements.meanAnomaly);
+        parents_.push_back(parent);
+        elements_.push_back(elements);
+
+        return int(parents_.size()) - 1;
+    }
+
+    int Size() const { return int(parents_.size()); }
+
+    int Parent(int idx) const { return parents_[idx]; }
+
+    const OrbitElements& Elements(int idx) const { return elements_[idx]; }
+
+    // Evaluates the world positions of all bodies at time t.
+    void Evaluate(double t, std::vector<glm::dvec3>& positions) const
+    {
+        const int n = Size();
+        positions.resize(n);
+        local_.resize(3 * n);
+
+        double* const lx = local_.data();
+        double* const ly = lx + n;
+        double* const lz = ly + n;
+
+        // positions relative to the parents, every body on its own
+        for (int i = 0; i < n; i++) {
+            double M = meanAnomaly_[i] + meanMotion_[i] * t;
+            M -= TWO_PI * floor(M / TWO_PI);
+
+            const double e = ecc_[i];
+            double E = e < 0.8 ? M : PI;
+            for (int k = 0; k < KEPLER_ITERATIONS; k++) {
+                E -= (E - e * sin(E) - M) / (1.0 - e * cos(E));
+            }
+
+            const double x = cos(E) - e;
+            const double y = sin(E);
+            lx[i] = px_[i] * x + qx_[i] * y;
+            ly[i] = py_[i] * x + qy_[i] * y;
+            lz[i] = pz_[i] * x + qz_[i] * y;
+        }
+
+        // parents come before children, so a single forward pass resolves the hierarchy
+        for (int i = 0; i < n; i++) {
+            glm::dvec3 p{lx[i], ly[i], lz[i]};
+            if (parents_[i] >= 0) {
+                p += positions[parents_[i]];
+            }
+            positions[i] = p;
+        }
+    }
+
+private:
+    std::vector<int> parents_;
+    std::vector<OrbitElements> elements_;
+
+    // SoA copies of the elements used by Evaluate
+    std::vector<double> px_, py_, pz_;
+    std::vector<double> qx_, qy_, qz_;
+    std::vector<double> ecc_;
+    std::vector<double> meanMotion_;
+    std::vector<double> meanAnomaly_;
+
+    mutable std::vector<double> local_;
+};
+
+} /* namespace cg */
+
+#endif /* CG_ORBIT_H_ */
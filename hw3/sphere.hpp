@@ -147,7 +147,7 @@ private:
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
 
-        numIdxSphere_ = int(faces.size() * sizeof(TriFace));
+        numIdxSphere_ = int(faces.size() * 3);
     }
 };
 
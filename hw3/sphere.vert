@@ -13,6 +13,9 @@ out vec2 mapCoord;
 
 uniform mat4 pvm;
 
+// the depth pre-pass and the shading pass must produce bit-identical depth
+invariant gl_Position;
+
 void main()
 {
 	gl_Position = pvm * vec4(position, 1.0);
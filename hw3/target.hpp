@@ -0,0 +1,84 @@
+#ifndef CG_TARGET_H_
+#define CG_TARGET_H_
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+namespace cg
+{
+
+/* An off-screen render target with a 32-bit floating-point depth buffer.
+ * The default framebuffer only offers fixed-point depth, which wastes most of the
+ * precision a reverse-Z projection gives. Render the scene here, then blit it to the screen.
+*/
+class RenderTarget
+{
+public:
+    RenderTarget(int width, int height) : FBO_(0), color_(0), depth_(0), width_(0), height_(0)
+    {
+        glGenFramebuffers(1, &FBO_);
+        glGenRenderbuffers(1, &color_);
+        glGenRenderbuffers(1, &depth_);
+        Resize(width, height);
+    }
+
+    virtual ~RenderTarget()
+    {
+        glDeleteFramebuffers(1, &FBO_);
+        glDeleteRenderbuffers(1, &color_);
+        glDeleteRenderbuffers(1, &depth_);
+    }
+
+    bool Resize(int width, int height)
+    {
+        if (width == width_ && height == height_) {
+            return true;
+        }
+        width_ = width;
+        height_ = height;
+
+        glBindRenderbuffer(GL_RENDERBUFFER, color_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);
+        const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (!complete) {
+            std::cerr << "ERROR: RenderTarget: framebuffer is not complete" << std::endl;
+        }
+        return complete;
+    }
+
+    void Bind() const { glBindFramebuffer(GL_FRAMEBUFFER, FBO_); }
+
+    // Copies the color buffer to the default framebuffer and leaves the default framebuffer bound.
+    void BlitToScreen() const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO_);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width_, height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    GLuint Framebuffer() const { return FBO_; }
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+
+private:
+    GLuint FBO_;
+    GLuint color_;
+    GLuint depth_;
+    int width_;
+    int height_;
+};
+
+} /* namespace cg */
+
+#endif /* CG_TARGET_H_ */
@@ -9,8 +9,23 @@ in vec2 mapCoord;
 out vec4 color;
 
 uniform sampler2D texMap;
+// depth of the snow cover in pixels, one texel per column
+uniform sampler2D snowCover;
+uniform float screenHeight;
+
+const vec3 SNOW_COLOR = vec3(0.94f, 0.96f, 1.0f);
 
 void main()
 {
 	color = texture(texMap, mapCoord);
+
+	// pixels from the top of the snow cover, negative below it
+	float cover = texture(snowCover, vec2(mapCoord.x, 0.5f)).r;
+	float above = mapCoord.y * screenHeight - cover;
+	if (cover > 0.0f && above < 1.0f) {
+		// a little darker deeper down, with an anti-aliased top edge
+		float depth = clamp(-above / 80.0f, 0.0f, 1.0f);
+		vec3 snow = SNOW_COLOR * (1.0f - 0.15f * depth);
+		color.rgb = mix(snow, color.rgb, clamp(above, 0.0f, 1.0f));
+	}
 }
@@ -0,0 +1,19 @@
+/*
+ * GLSL Fragment Shader code for OpenGL version 3.3
+ */
+
+#version 330 core
+
+in vec2 mapCoord;
+in vec4 color;
+
+out vec4 fragColor;
+
+void main()
+{
+	// a round glow, white-hot in the middle
+	float d = length(mapCoord - vec2(0.5f)) * 2.0f;
+	float glow = clamp(1.0f - d, 0.0f, 1.0f);
+	glow *= glow;
+	fragColor = vec4(mix(color.rgb, vec3(1.0f), glow * glow), color.a * glow);
+}
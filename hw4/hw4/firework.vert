@@ -0,0 +1,25 @@
+/*
+ * GLSL Vertex Shader code for OpenGL version 3.3
+ */
+
+#version 330 core
+
+// input vertex attributes
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 texCoord;
+// per-spark attributes: <vec2 offset, float size, float alpha> and color
+layout (location = 2) in vec4 spark;
+layout (location = 3) in vec3 sparkColor;
+
+out vec2 mapCoord;
+out vec4 color;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+void main()
+{
+	gl_Position = projection * view * vec4((position.xy * spark.z) + spark.xy, 0, 1.0);
+	mapCoord = texCoord;
+	color = vec4(sparkColor, spark.w);
+}
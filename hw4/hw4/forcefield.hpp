@@ -0,0 +1,358 @@
+#ifndef CG_FORCEFIELD_H_
+#define CG_FORCEFIELD_H_
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "jobs.hpp"
+#include "random.hpp"
+
+namespace cg
+{
+
+/* Wind acting on particles: a steady wind with gusts, plus turbulence from a precomputed
+ * curl-noise volume.
+ *
+ * The volume is the curl of a smooth random vector potential (two octaves of tileable gradient
+ * noise), so the flow is divergence-free and swirls without sources or sinks. It is built in
+ * parallel and cached to a file. Particles move in the XY plane, the third axis of the volume is
+ * scrolled through with time, so the turbulence keeps changing.
+ * Particles are dragged towards the air velocity, so light particles follow the wind.
+ * With AVX2, Apply() samples 8 particles at a time, gathering the corners of their cells from the volume.
+*/
+class ForceField
+{
+public:
+	// cells per axis, a power of two so indices wrap with a mask
+	static constexpr int RESOLUTION = 64;
+	static constexpr int MASK = RESOLUTION - 1;
+	// noise octaves summed into the potential
+	static constexpr int OCTAVES = 2;
+
+	// cellSize: pixels per cell, turbulence: top speed of the turbulence in pixels per second,
+	// wind: mean wind velocity, gustiness: strength of the gusts relative to the wind,
+	// drag: how fast particles take the air velocity, per second
+	ForceField(uint64_t seed, float cellSize, float turbulence, glm::vec2 wind, float gustiness, float drag) :
+		seed(seed),
+		invCellSize(1.0f / cellSize),
+		turbulence(turbulence),
+		wind(wind),
+		gustiness(gustiness),
+		drag(drag),
+		evolution(0.25f)
+	{
+	}
+
+	virtual ~ForceField() { }
+
+	// Loads the volume from the cache file if it was built with the same settings,
+	// otherwise builds it and writes the cache. Returns false if the cache cannot be written.
+	bool Build(JobSystem& jobs, const std::string& cacheFile)
+	{
+		if (load(cacheFile)) {
+			return true;
+		}
+
+		compute(jobs);
+		return save(cacheFile);
+	}
+
+	// Mean wind with gusts at time t.
+	glm::vec2 Wind(float t) const
+	{
+		const float gust = 0.6f * sin(0.7f * t) + 0.3f * sin(1.9f * t + 1.3f) + 0.1f * sin(4.3f * t + 0.4f);
+		return wind * (1.0f + gustiness * gust);
+	}
+
+	// Turbulence velocity at a point of the XY plane at time t.
+	glm::vec2 Turbulence(float x, float y, float t) const
+	{
+		float ux, uy;
+		sample(x * invCellSize, y * invCellSize, t * evolution, ux, uy);
+		return turbulence * glm::vec2{ux, uy};
+	}
+
+	// Drags the velocities of particles [begin, end) towards the air velocity for a step of dt.
+	void Apply(int begin, int end, float t, float dt, const float* posX, const float* posY, float* velX, float* velY) const
+	{
+		const glm::vec2 w = Wind(t);
+		const float z = t * evolution;
+		const float k = std::min(drag * dt, 1.0f);
+		int i = begin;
+#ifdef __AVX2__
+		// all particles sample the same two slices of the volume
+		const float fz = floor(z);
+		const int iz = int(fz);
+		const __m256 tz = _mm256_set1_ps(z - fz);
+		const __m256i slices[2] = {
+			_mm256_set1_epi32((iz & MASK) * RESOLUTION * RESOLUTION),
+			_mm256_set1_epi32(((iz + 1) & MASK) * RESOLUTION * RESOLUTION)
+		};
+		const __m256i mask = _mm256_set1_epi32(MASK);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i row = _mm256_set1_epi32(RESOLUTION);
+		const __m256 scale = _mm256_set1_ps(invCellSize);
+		const __m256 strength = _mm256_set1_ps(turbulence);
+		const __m256 wx = _mm256_set1_ps(w.x), wy = _mm256_set1_ps(w.y);
+		const __m256 rate = _mm256_set1_ps(k);
+		for (; i + 8 <= end; i += 8) {
+			const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(posX + i), scale);
+			const __m256 y = _mm256_mul_ps(_mm256_loadu_ps(posY + i), scale);
+			const __m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y);
+			const __m256 tx = _mm256_sub_ps(x, fx), ty = _mm256_sub_ps(y, fy);
+			const __m256i ix = _mm256_cvttps_epi32(fx), iy = _mm256_cvttps_epi32(fy);
+			const __m256i x0 = _mm256_and_si256(ix, mask);
+			const __m256i x1 = _mm256_and_si256(_mm256_add_epi32(ix, one), mask);
+			const __m256i y0 = _mm256_mullo_epi32(_mm256_and_si256(iy, mask), row);
+			const __m256i y1 = _mm256_mullo_epi32(_mm256_and_si256(_mm256_add_epi32(iy, one), mask), row);
+
+			__m256 cx[2], cy[2];
+			for (int dz = 0; dz < 2; dz++) {
+				const __m256i r0 = _mm256_add_epi32(slices[dz], y0), r1 = _mm256_add_epi32(slices[dz], y1);
+				const __m256i i00 = _mm256_add_epi32(r0, x0), i10 = _mm256_add_epi32(r0, x1);
+				const __m256i i01 = _mm256_add_epi32(r1, x0), i11 = _mm256_add_epi32(r1, x1);
+				const __m256 ax = lerp(_mm256_i32gather_ps(vx.data(), i00, 4), _mm256_i32gather_ps(vx.data(), i10, 4), tx);
+				const __m256 bx = lerp(_mm256_i32gather_ps(vx.data(), i01, 4), _mm256_i32gather_ps(vx.data(), i11, 4), tx);
+				const __m256 ay = lerp(_mm256_i32gather_ps(vy.data(), i00, 4), _mm256_i32gather_ps(vy.data(), i10, 4), tx);
+				const __m256 by = lerp(_mm256_i32gather_ps(vy.data(), i01, 4), _mm256_i32gather_ps(vy.data(), i11, 4), tx);
+				cx[dz] = lerp(ax, bx, ty);
+				cy[dz] = lerp(ay, by, ty);
+			}
+			const __m256 ux = lerp(cx[0], cx[1], tz), uy = lerp(cy[0], cy[1], tz);
+
+			const __m256 vX = _mm256_loadu_ps(velX + i), vY = _mm256_loadu_ps(velY + i);
+			const __m256 airX = _mm256_add_ps(wx, _mm256_mul_ps(strength, ux));
+			const __m256 airY = _mm256_add_ps(wy, _mm256_mul_ps(strength, uy));
+			_mm256_storeu_ps(velX + i, _mm256_add_ps(vX, _mm256_mul_ps(_mm256_sub_ps(airX, vX), rate)));
+			_mm256_storeu_ps(velY + i, _mm256_add_ps(vY, _mm256_mul_ps(_mm256_sub_ps(airY, vY), rate)));
+		}
+#endif
+		for (; i < end; i++) {
+			float ux, uy;
+			sample(posX[i] * invCellSize, posY[i] * invCellSize, z, ux, uy);
+			velX[i] += (w.x + turbulence * ux - velX[i]) * k;
+			velY[i] += (w.y + turbulence * uy - velY[i]) * k;
+		}
+	}
+
+private:
+	static constexpr uint32_t CACHE_MAGIC = 0x4C525543;   // "CURL"
+	static constexpr uint32_t CACHE_VERSION = 1;
+
+	uint64_t seed;
+	float invCellSize;
+	float turbulence;
+	glm::vec2 wind;
+	float gustiness;
+	float drag;
+	float evolution;    // cells of the volume scrolled per second
+
+	// velocity at each cell, x fastest, normalized so the fastest cell has speed 1
+	std::vector<float> vx, vy, vz;
+
+	static int index(int x, int y, int z)
+	{
+		return ((z & MASK) * RESOLUTION + (y & MASK)) * RESOLUTION + (x & MASK);
+	}
+
+	// trilinear interpolation of the XY velocity at a point in cell units, wrapping around
+	void sample(float x, float y, float z, float& ux, float& uy) const
+	{
+		const float fx = floor(x), fy = floor(y), fz = floor(z);
+		const int ix = int(fx), iy = int(fy), iz = int(fz);
+		const float tx = x - fx, ty = y - fy, tz = z - fz;
+
+		float cx[2], cy[2];
+		for (int dz = 0; dz < 2; dz++) {
+			const int i00 = index(ix, iy, iz + dz), i10 = index(ix + 1, iy, iz + dz);
+			const int i01 = index(ix, iy + 1, iz + dz), i11 = index(ix + 1, iy + 1, iz + dz);
+			const float x0 = vx[i00] + (vx[i10] - vx[i00]) * tx;
+			const float x1 = vx[i01] + (vx[i11] - vx[i01]) * tx;
+			const float y0 = vy[i00] + (vy[i10] - vy[i00]) * tx;
+			const float y1 = vy[i01] + (vy[i11] - vy[i01]) * tx;
+			cx[dz] = x0 + (x1 - x0) * ty;
+			cy[dz] = y0 + (y1 - y0) * ty;
+		}
+		ux = cx[0] + (cx[1] - cx[0]) * tz;
+		uy = cy[0] + (cy[1] - cy[0]) * tz;
+	}
+
+#ifdef __AVX2__
+	static __m256 lerp(__m256 a, __m256 b, __m256 t)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+	}
+#endif
+
+	static float fade(float t)
+	{
+		return t * t * t * (t * (t * 6 - 15) + 10);
+	}
+
+	// tileable gradient noise, grad holds period^3 unit gradients
+	static float gradientNoise(const std::vector<glm::vec3>& grad, int period, glm::vec3 p)
+	{
+		const glm::vec3 f = glm::floor(p);
+		const glm::vec3 t = p - f;
+		const int ix = int(f.x), iy = int(f.y), iz = int(f.z);
+
+		float corners[8];
+		for (int c = 0; c < 8; c++) {
+			const int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+			const int gi = (((iz + dz) % period) * period + (iy + dy) % period) * period + (ix + dx) % period;
+			corners[c] = glm::dot(grad[gi], t - glm::vec3{float(dx), float(dy), float(dz)});
+		}
+
+		const float u = fade(t.x), v = fade(t.y), w = fade(t.z);
+		const float x00 = corners[0] + (corners[1] - corners[0]) * u;
+		const float x10 = corners[2] + (corners[3] - corners[2]) * u;
+		const float x01 = corners[4] + (corners[5] - corners[4]) * u;
+		const float x11 = corners[6] + (corners[7] - corners[6]) * u;
+		const float y0 = x00 + (x10 - x00) * v;
+		const float y1 = x01 + (x11 - x01) * v;
+		return y0 + (y1 - y0) * w;
+	}
+
+	void compute(JobSystem& jobs)
+	{
+		const int cells = RESOLUTION * RESOLUTION * RESOLUTION;
+		const int periods[OCTAVES] = {4, 8};
+		const float amplitudes[OCTAVES] = {1.0f, 0.5f};
+
+		// random gradients of each octave and potential component, from a seeded stream
+		std::vector<glm::vec3> grad[OCTAVES][3];
+		for (int o = 0; o < OCTAVES; o++) {
+			const int n = periods[o] * periods[o] * periods[o];
+			for (int c = 0; c < 3; c++) {
+				RandomStream random(seed, uint32_t(o * 3 + c));
+				grad[o][c].resize(n);
+				for (int i = 0; i < n; i++) {
+					glm::vec3 g;
+					do {
+						g = glm::vec3{random.Next(-1, 1), random.Next(-1, 1), random.Next(-1, 1)};
+					} while (glm::dot(g, g) > 1.0f || glm::dot(g, g) < 1e-4f);
+					grad[o][c][i] = glm::normalize(g);
+				}
+			}
+		}
+
+		// vector potential, one z slice per job
+		std::vector<float> potential[3];
+		for (auto& p : potential) {
+			p.resize(cells);
+		}
+		jobs.ParallelFor(RESOLUTION, 1, [&](int begin, int end) {
+			for (int z = begin; z < end; z++) {
+				for (int y = 0; y < RESOLUTION; y++) {
+					for (int x = 0; x < RESOLUTION; x++) {
+						for (int c = 0; c < 3; c++) {
+							float sum = 0;
+							for (int o = 0; o < OCTAVES; o++) {
+								const glm::vec3 p = glm::vec3{float(x), float(y), float(z)} * float(periods[o]) / float(RESOLUTION);
+								sum += amplitudes[o] * gradientNoise(grad[o][c], periods[o], p);
+							}
+							potential[c][index(x, y, z)] = sum;
+						}
+					}
+				}
+			}
+		});
+
+		// velocity = curl of the potential, by central differences
+		vx.resize(cells);
+		vy.resize(cells);
+		vz.resize(cells);
+		std::vector<float> sliceMax(RESOLUTION, 0.0f);
+		jobs.ParallelFor(RESOLUTION, 1, [&](int begin, int end) {
+			const auto& px = potential[0];
+			const auto& py = potential[1];
+			const auto& pz = potential[2];
+			for (int z = begin; z < end; z++) {
+				for (int y = 0; y < RESOLUTION; y++) {
+					for (int x = 0; x < RESOLUTION; x++) {
+						const float dzdy = pz[index(x, y + 1, z)] - pz[index(x, y - 1, z)];
+						const float dydz = py[index(x, y, z + 1)] - py[index(x, y, z - 1)];
+						const float dxdz = px[index(x, y, z + 1)] - px[index(x, y, z - 1)];
+						const float dzdx = pz[index(x + 1, y, z)] - pz[index(x - 1, y, z)];
+						const float dydx = py[index(x + 1, y, z)] - py[index(x - 1, y, z)];
+						const float dxdy = px[index(x, y + 1, z)] - px[index(x, y - 1, z)];
+
+						const int i = index(x, y, z);
+						vx[i] = dzdy - dydz;
+						vy[i] = dxdz - dzdx;
+						vz[i] = dydx - dxdy;
+						sliceMax[z] = std::max(sliceMax[z], vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+					}
+				}
+			}
+		});
+
+		const float maxSpeed = sqrt(*std::max_element(sliceMax.begin(), sliceMax.end()));
+		if (maxSpeed > 0) {
+			const float scale = 1.0f / maxSpeed;
+			for (int i = 0; i < cells; i++) {
+				vx[i] *= scale;
+				vy[i] *= scale;
+				vz[i] *= scale;
+			}
+		}
+	}
+
+	bool load(const std::string& file)
+	{
+		std::ifstream in(file, std::ios::binary);
+		if (!in) {
+			return false;
+		}
+
+		uint32_t header[4];
+		uint64_t fileSeed;
+		in.read(reinterpret_cast<char*>(header), sizeof(header));
+		in.read(reinterpret_cast<char*>(&fileSeed), sizeof(fileSeed));
+		if (!in || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION
+			|| header[2] != uint32_t(RESOLUTION) || header[3] != uint32_t(OCTAVES) || fileSeed != seed) {
+			return false;
+		}
+
+		const int cells = RESOLUTION * RESOLUTION * RESOLUTION;
+		vx.resize(cells);
+		vy.resize(cells);
+		vz.resize(cells);
+		in.read(reinterpret_cast<char*>(vx.data()), cells * sizeof(float));
+		in.read(reinterpret_cast<char*>(vy.data()), cells * sizeof(float));
+		in.read(reinterpret_cast<char*>(vz.data()), cells * sizeof(float));
+		return bool(in);
+	}
+
+	bool save(const std::string& file) const
+	{
+		std::ofstream out(file, std::ios::binary);
+		if (!out) {
+			std::cerr << "WARNING: ForceField: cannot write cache file '" << file << "'" << std::endl;
+			return false;
+		}
+
+		const uint32_t header[4] = {CACHE_MAGIC, CACHE_VERSION, uint32_t(RESOLUTION), uint32_t(OCTAVES)};
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(&seed), sizeof(seed));
+		out.write(reinterpret_cast<const char*>(vx.data()), vx.size() * sizeof(float));
+		out.write(reinterpret_cast<const char*>(vy.data()), vy.size() * sizeof(float));
+		out.write(reinterpret_cast<const char*>(vz.data()), vz.size() * sizeof(float));
+		return bool(out);
+	}
+};
+
+} /* namespace cg */
+
+#endif /* CG_FORCEFIELD_H_ */
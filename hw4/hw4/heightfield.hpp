@@ -0,0 +1,165 @@
+#ifndef CG_HEIGHTFIELD_H_
+#define CG_HEIGHTFIELD_H_
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+namespace cg
+{
+
+/// Snow added to a column of the heightfield by a landed flake.
+struct Deposit
+{
+	int column;
+	float amount;
+};
+
+/* Depth of the snow lying on the ground, in pixels above the bottom of the window.
+ * The window width is divided into COLUMNS columns, so finding the ground under a flake is O(1).
+ * Landed flakes are collected into batches of deposits and added with Apply(), then steep
+ * slopes slide down with Settle(). The heights are kept in a one-row R32F texture that is
+ * updated only where they changed.
+*/
+class Heightfield
+{
+public:
+	static constexpr int COLUMNS = 512;
+
+	// packing: fraction of a landed flake's area which becomes snow cover
+	// maxSlope: steepest height difference between two columns, in column widths
+	Heightfield(float width, float maxHeight, float packing = 0.05f, float maxSlope = 1.0f) :
+		heights(COLUMNS, 0.0f),
+		maxHeight(maxHeight),
+		packing(packing),
+		maxSlope(maxSlope),
+		dirtyBegin(COLUMNS),
+		dirtyEnd(0),
+		texture(0)
+	{
+		SetWidth(width);
+	}
+
+	virtual ~Heightfield() { }
+
+	void SetWidth(float width)
+	{
+		this->width = width;
+		columnWidth = width / COLUMNS;
+	}
+
+	void SetMaxHeight(float maxHeight)
+	{
+		this->maxHeight = maxHeight;
+	}
+
+	float Width() const { return width; }
+	float ColumnWidth() const { return columnWidth; }
+	float Height(int column) const { return heights[column]; }
+	const float* Heights() const { return heights.data(); }
+
+	// The column under x, where x = 0 is the center of the window.
+	int Column(float x) const
+	{
+		return glm::clamp(int((x + width / 2) / columnWidth), 0, COLUMNS - 1);
+	}
+
+	// The deposit of a flake of the given size landing at x.
+	Deposit Land(float x, float size) const
+	{
+		return {Column(x), packing * size * size / columnWidth};
+	}
+
+	void Apply(const std::vector<Deposit>& batch)
+	{
+		for (const auto& d : batch) {
+			heights[d.column] = std::min(heights[d.column] + d.amount, maxHeight);
+			markDirty(d.column, d.column + 1);
+		}
+	}
+
+	// Moves snow from columns steeper than the max slope to their lower neighbour.
+	void Settle()
+	{
+		const float maxStep = maxSlope * columnWidth;
+		for (int i = 0; i + 1 < COLUMNS; i++) {
+			const float diff = heights[i] - heights[i + 1];
+			if (std::abs(diff) > maxStep) {
+				const float moved = std::copysign((std::abs(diff) - maxStep) / 2, diff);
+				heights[i] -= moved;
+				heights[i + 1] += moved;
+				markDirty(i, i + 2);
+			}
+		}
+	}
+
+	void Clear()
+	{
+		std::fill(heights.begin(), heights.end(), 0.0f);
+		markDirty(0, COLUMNS);
+	}
+
+	void SetupTexture()
+	{
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, COLUMNS, 1, 0, GL_RED, GL_FLOAT, heights.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		dirtyBegin = COLUMNS;
+		dirtyEnd = 0;
+	}
+
+	void ReleaseTexture()
+	{
+		glDeleteTextures(1, &texture);
+		texture = 0;
+	}
+
+	// Uploads the columns changed since the last upload.
+	void Upload()
+	{
+		if (dirtyBegin >= dirtyEnd) {
+			return;
+		}
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, dirtyBegin, 0, dirtyEnd - dirtyBegin, 1, GL_RED, GL_FLOAT, heights.data() + dirtyBegin);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		dirtyBegin = COLUMNS;
+		dirtyEnd = 0;
+	}
+
+	GLuint Texture() const { return texture; }
+
+private:
+	std::vector<float> heights;
+
+	float width;
+	float columnWidth;
+	float maxHeight;
+	float packing;
+	float maxSlope;
+
+	// columns changed since the last upload
+	int dirtyBegin;
+	int dirtyEnd;
+
+	GLuint texture;
+
+	void markDirty(int begin, int end)
+	{
+		dirtyBegin = std::min(dirtyBegin, begin);
+		dirtyEnd = std::max(dirtyEnd, end);
+	}
+};
+
+} /* namespace cg */
+
+#endif /* CG_HEIGHTFIELD_H_ */
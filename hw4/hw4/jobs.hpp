@@ -0,0 +1,295 @@
+#ifndef CG_JOBS_H_
+#define CG_JOBS_H_
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace cg
+{
+
+constexpr int CACHE_LINE = 64;
+
+/// Allocator returning cache-line aligned storage, so that chunks of a multiple of
+/// CACHE_LINE bytes never share a line with their neighbours.
+template <typename T>
+struct CacheAlignedAllocator
+{
+	using value_type = T;
+
+	CacheAlignedAllocator() = default;
+	template <typename U>
+	CacheAlignedAllocator(const CacheAlignedAllocator<U>&) { }
+
+	T* allocate(std::size_t n)
+	{
+		// over-allocate and keep the original pointer right before the aligned block; through
+		// ::operator new like every other container, so a replaced operator new sees it too
+		char* raw = static_cast<char*>(::operator new(n * sizeof(T) + CACHE_LINE + sizeof(void*)));
+		std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + CACHE_LINE - 1) & ~std::uintptr_t(CACHE_LINE - 1);
+		reinterpret_cast<void**>(aligned)[-1] = raw;
+		return reinterpret_cast<T*>(aligned);
+	}
+
+	void deallocate(T* p, std::size_t)
+	{
+		::operator delete(reinterpret_cast<void**>(p)[-1]);
+	}
+
+	template <typename U>
+	bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+	template <typename U>
+	bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, CacheAlignedAllocator<T>>;
+
+/// Number of unfinished jobs in a group, see JobSystem::Wait.
+struct JobCounter
+{
+	std::atomic<int> pending{0};
+
+	bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+/* A small job system with one worker thread per core.
+ *
+ * Every worker owns a double-ended queue of jobs: it pops its own jobs from the back, and when it runs out,
+ * steals from the front of the other deques. A thread waiting for a group of jobs keeps running
+ * jobs in the meantime, so jobs may submit and wait for other jobs.
+ * A job is a plain function pointer with a context and an index range, nothing is allocated per job.
+*/
+class JobSystem
+{
+public:
+	using JobFunc = void (*)(void* context, int begin, int end);
+
+	explicit JobSystem(int numWorkers = 0) : stop_(false), queued_(0), next_(0)
+	{
+		if (numWorkers <= 0) {
+			numWorkers = std::max(1, int(std::thread::hardware_concurrency()));
+		}
+		for (int i = 0; i < numWorkers; i++) {
+			queues_.emplace_back(new Queue);
+		}
+		for (int i = 0; i < numWorkers; i++) {
+			threads_.emplace_back(&JobSystem::workerLoop, this, i);
+		}
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	virtual ~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+			stop_ = true;
+		}
+		wakeUp_.notify_all();
+		for (auto& t : threads_) {
+			t.join();
+		}
+	}
+
+	int Workers() const { return int(threads_.size()); }
+
+	// Runs func(context, begin, end) on some worker and decrements the counter when it is done.
+	void Submit(JobFunc func, void* context, int begin, int end, JobCounter& counter)
+	{
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+		// a worker pushes to its own deque, other threads spread the jobs over all workers
+		int idx = currentWorker();
+		if (idx < 0) {
+			idx = int(next_.fetch_add(1, std::memory_order_relaxed) % unsigned(queues_.size()));
+		}
+		{
+			std::lock_guard<std::mutex> lock(queues_[idx]->mutex);
+			queues_[idx]->PushBack({func, context, begin, end, &counter});
+		}
+		queued_.fetch_add(1, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+		}
+		wakeUp_.notify_one();
+	}
+
+	// Blocks until all jobs of the group are finished, running other jobs while waiting.
+	void Wait(JobCounter& counter)
+	{
+		while (!counter.Done()) {
+			Job job;
+			if (takeJob(currentWorker(), job)) {
+				run(job);
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Calls body(begin, end) over [0, count) in pieces of grain elements and waits for all of them.
+	template <typename F>
+	void ParallelFor(int count, int grain, const F& body)
+	{
+		if (count <= grain) {
+			if (count > 0) {
+				body(0, count);
+			}
+			return;
+		}
+
+		JobCounter counter;
+		for (int begin = 0; begin < count; begin += grain) {
+			Submit(&invoke<F>, const_cast<F*>(&body), begin, std::min(begin + grain, count), counter);
+		}
+		Wait(counter);
+	}
+
+private:
+	struct Job
+	{
+		JobFunc func;
+		void* context;
+		int begin;
+		int end;
+		JobCounter* counter;
+	};
+
+	// A ring buffer of jobs that only grows when it is full, so once warm no job allocates.
+	struct Queue
+	{
+		std::mutex mutex;
+		std::vector<Job> ring;      // the size is 0 or a power of two
+		std::size_t head = 0;       // oldest job
+		std::size_t size = 0;
+
+		void PushBack(const Job& job)
+		{
+			if (size == ring.size()) {
+				std::vector<Job> larger(std::max<std::size_t>(64, 2 * ring.size()));
+				for (std::size_t k = 0; k < size; k++) {
+					larger[k] = ring[(head + k) & (ring.size() - 1)];
+				}
+				ring.swap(larger);
+				head = 0;
+			}
+			ring[(head + size++) & (ring.size() - 1)] = job;
+		}
+
+		Job PopBack()
+		{
+			return ring[(head + --size) & (ring.size() - 1)];
+		}
+
+		Job PopFront()
+		{
+			const Job job = ring[head];
+			head = (head + 1) & (ring.size() - 1);
+			size--;
+			return job;
+		}
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues_;
+	std::vector<std::thread> threads_;
+
+	std::mutex sleepMutex_;
+	std::condition_variable wakeUp_;
+	bool stop_;
+
+	std::atomic<int> queued_;
+	std::atomic<unsigned> next_;
+
+	template <typename F>
+	static void invoke(void* context, int begin, int end)
+	{
+		(*static_cast<const F*>(context))(begin, end);
+	}
+
+	// index of the calling thread if it is one of our workers, -1 otherwise
+	int currentWorker() const
+	{
+		return owner() == this ? workerIndex() : -1;
+	}
+
+	static const JobSystem*& owner()
+	{
+		static thread_local const JobSystem* system = nullptr;
+		return system;
+	}
+
+	static int& workerIndex()
+	{
+		static thread_local int idx = -1;
+		return idx;
+	}
+
+	bool takeJob(int self, Job& job)
+	{
+		if (queued_.load(std::memory_order_acquire) == 0) {
+			return false;
+		}
+
+		const int n = int(queues_.size());
+		if (self >= 0) {
+			Queue& own = *queues_[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (own.size > 0) {
+				job = own.PopBack();
+				queued_.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		// steal the oldest job of another worker
+		const int start = self >= 0 ? self + 1 : 0;
+		for (int k = 0; k < n; k++) {
+			Queue& victim = *queues_[(start + k) % n];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (victim.size > 0) {
+				job = victim.PopFront();
+				queued_.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static void run(const Job& job)
+	{
+		job.func(job.context, job.begin, job.end);
+		job.counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+
+	void workerLoop(int idx)
+	{
+		owner() = this;
+		workerIndex() = idx;
+
+		while (true) {
+			Job job;
+			if (takeJob(idx, job)) {
+				run(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex_);
+			wakeUp_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+			if (stop_) {
+				return;
+			}
+		}
+	}
+};
+
+} /* namespace cg */
+
+#endif /* CG_JOBS_H_ */
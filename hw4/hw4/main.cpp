@@ -2,6 +2,15 @@
  * OpenGL version 3.3 project.
  */
 #include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -14,6 +23,12 @@
 
 #include "shader.hpp"
 #include "snow.hpp"
+#include "heightfield.hpp"
+#include "forcefield.hpp"
+#include "particlesys.hpp"
+#include "spatialgrid.hpp"
+#include "radixsort.hpp"
+#include "jobs.hpp"
 
 using namespace cg;
 
@@ -21,7 +36,32 @@ using namespace cg;
 int screenWidth = 800;
 int screenHeight = 600;
 
-Snowing snowing(3, 0.15f, 0.5f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0});
+// size of the snowflake pool, no flakes are allocated beyond it
+constexpr int MAX_SNOWFLAKES = 4096;
+
+Snowing snowing(3, 0.15f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0}, MAX_SNOWFLAKES);
+
+// the snow on the ground, at most a third of the window high
+Heightfield ground(float(screenWidth), screenHeight / 3.0f);
+
+// a light breeze to the right with gusts and turbulence, cached in CURL_CACHE
+ForceField wind(2021, 24.0f, 40.0f, {15.0f, 0}, 0.8f, 0.1f);
+constexpr const char* const CURL_CACHE = "curlnoise.bin";
+bool windOn = true;
+
+// flakes fade in over this many pixels above the snow cover
+constexpr float SOFT_EDGE = 6.0f;
+
+// 8 shells of 300 sparks each
+FireWork fireworks(8, 300, screenWidth, screenHeight, 420.0f, 160.0f, {0, -200.0f}, 2.0f);
+
+enum class Effect : int
+{
+    SNOW,
+    FIREWORKS
+};
+
+Effect currentEffect = Effect::SNOW;
 
 // normalized coordinates
 constexpr GLfloat background[] = {
@@ -39,10 +79,44 @@ constexpr GLfloat background[] = {
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 
-void drawBackground(const Shader& shader, GLuint VAO, GLuint texture, const glm::mat4& view, const glm::mat4& projection);
+void drawBackground(const Shader& shader, GLuint VAO, GLuint texture, GLuint coverTexture, const glm::mat4& view, const glm::mat4& projection);
+GLuint loadSprite(const char* path);
+
+// heap allocations so far. Only --bench reads the count (it checks that the flake pool does not
+// allocate while it updates), but operator new can only be replaced for the whole program, so
+// the interactive app counts too.
+std::atomic<long long> allocations{0};
+
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size > 0 ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
 
-int main()
+void operator delete(void* p) noexcept
 {
+	std::free(p);
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start);
+void benchPool(JobSystem& jobs);
+void benchScaling();
+void benchDeterminism();
+void benchGround(JobSystem& jobs);
+void benchWind();
+void benchFireworks();
+void benchGrid(JobSystem& jobs);
+void benchSort(JobSystem& jobs);
+void benchFill(JobSystem& jobs, const Shader& snowShader, GLuint texSnow, GLuint quadVBO);
+
+int main(int argc, char* argv[])
+{
+	// with --bench, run the benchmarks in a hidden window and exit
+	const bool benchmark = argc > 1 && std::string(argv[1]) == "--bench";
+
 	// Setup a GLFW window
 
 	// init GLFW, set GL version & pipeline info
@@ -50,6 +124,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, benchmark ? GLFW_FALSE : GLFW_TRUE);
 
 	// create a window
 	GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Yifei Li - Assignment 4", nullptr, nullptr);
@@ -97,6 +172,13 @@ int main()
         return -3;
     }
 
+    auto fireShader = Shader::Create("firework.vert", "firework.frag");
+    if (fireShader == nullptr) {
+        std::cerr << "Error creating Shader Program" << std::endl;
+        glfwTerminate();
+        return -3;
+    }
+
     GLuint texBack = 0;
     if ((texBack = SOIL_load_OGL_texture(
         "bg.jpg",
@@ -109,11 +191,7 @@ int main()
     glBindTexture(GL_TEXTURE_2D, 0);
 
     GLuint texSnow = 0;
-    if ((texSnow = SOIL_load_OGL_texture(
-        "snow.png",
-        SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID,
-        SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-    )) == 0) {
+    if ((texSnow = loadSprite("snow.png")) == 0) {
         glfwTerminate();
         glDeleteTextures(1, &texBack);
         return -4;
@@ -148,6 +226,43 @@ int main()
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 
+	// one worker per core simulates the snow while the main thread draws
+	JobSystem jobs;
+
+	// snowflakes are drawn instanced from the same quad
+	snowing.SetupBuffers(VBO);
+	fireworks.SetupBuffers(VBO);
+
+	ground.SetupTexture();
+	snowing.SetGround(&ground);
+	snowing.SetSoftEdge(SOFT_EDGE);
+
+	if (!wind.Build(jobs, CURL_CACHE)) {
+		std::cerr << "Curl noise is not cached, it will be built again next time" << std::endl;
+	}
+	snowing.SetForceField(&wind);
+
+	if (benchmark) {
+		benchPool(jobs);
+		benchScaling();
+		benchDeterminism();
+		benchGround(jobs);
+		benchWind();
+		benchFireworks();
+		benchGrid(jobs);
+		benchSort(jobs);
+		benchFill(jobs, *snowShader, texSnow, VBO);
+		snowing.ReleaseBuffers();
+		fireworks.ReleaseBuffers();
+		ground.ReleaseTexture();
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteTextures(1, &texBack);
+		glDeleteTextures(1, &texSnow);
+		glfwTerminate();
+		return 0;
+	}
+
 	// ---------------------------------------------------------------
 
 	// Define the viewport dimensions
@@ -165,16 +280,30 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // the snow of this frame was simulated during the last one
+        snowing.FinishUpdate();
+        ground.Upload();
+
 		// check event queue
 		glfwPollEvents();
 
 		/* your update code here */
-        snowing.Update(deltaTime);
+        if (currentEffect == Effect::SNOW) {
+            snowing.StartUpdate(deltaTime, jobs);
+        } else {
+            fireworks.Update(deltaTime);
+        }
 	
 		// draw background
 		GLfloat red = 0.2f;
 		GLfloat green = 0.3f;
 		GLfloat blue = 0.3f;
+        if (currentEffect == Effect::FIREWORKS) {
+            // night sky
+            red = 0.01f;
+            green = 0.01f;
+            blue = 0.05f;
+        }
 		glClearColor(red, green, blue, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -190,14 +319,28 @@ int main()
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 		// draw
-        drawBackground(*backShader, VAO, texBack, view, projection);
-        snowing.Draw(*snowShader, VAO, texSnow, view, projection);
+        if (currentEffect == Effect::SNOW) {
+            drawBackground(*backShader, VAO, texBack, ground.Texture(), view, projection);
+            // flakes come sorted back to front, they only test depth against the background
+            glDepthMask(GL_FALSE);
+            snowing.Draw(*snowShader, texSnow, view, projection);
+            glDepthMask(GL_TRUE);
+        } else {
+            // sparks all lie at the same depth and are added up, keep them from hiding each other
+            glDepthMask(GL_FALSE);
+            fireworks.Draw(*fireShader, view, projection);
+            glDepthMask(GL_TRUE);
+        }
 
 		// swap buffer
 		glfwSwapBuffers(window);
 	}
 
 	// properly de-allocate all resources
+    snowing.FinishUpdate();
+    snowing.ReleaseBuffers();
+    fireworks.ReleaseBuffers();
+    ground.ReleaseTexture();
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
     glDeleteTextures(1, &texBack);
@@ -215,6 +358,23 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	}
+	// toggle wind
+	if (key == GLFW_KEY_W && action == GLFW_PRESS) {
+		windOn = !windOn;
+		snowing.SetForceField(windOn ? &wind : nullptr);
+	}
+	// toggle collisions between snowflakes
+	if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+		snowing.SetCollisions(!snowing.Collisions());
+	}
+	// toggle soft flake edges at the snow cover
+	if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+		snowing.SetSoftEdge(snowing.SoftEdge() > 0 ? 0.0f : SOFT_EDGE);
+	}
+	// switch effect
+	if (key == GLFW_KEY_ENTER && action == GLFW_PRESS) {
+		currentEffect = currentEffect == Effect::SNOW ? Effect::FIREWORKS : Effect::SNOW;
+	}
 }
 
 void framebufferSizeCallback(GLFWwindow* window, int width, int height)
@@ -222,11 +382,14 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
     screenWidth = width;
     screenHeight = height;
     snowing.SetPositionRange(screenWidth, screenHeight);
+    fireworks.SetPositionRange(screenWidth, screenHeight);
+    ground.SetWidth(float(screenWidth));
+    ground.SetMaxHeight(screenHeight / 3.0f);
 	// resize window
 	glViewport(0, 0, width, height);
 }
 
-void drawBackground(const Shader& shader, GLuint VAO, GLuint texture, const glm::mat4& view, const glm::mat4& projection)
+void drawBackground(const Shader& shader, GLuint VAO, GLuint texture, GLuint coverTexture, const glm::mat4& view, const glm::mat4& projection)
 {
     glm::mat4 model = glm::translate(
         glm::scale(glm::mat4(1.0f), {screenWidth, screenHeight, 1.0f}),
@@ -237,10 +400,419 @@ void drawBackground(const Shader& shader, GLuint VAO, GLuint texture, const glm:
     glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "projection"), 1, false, glm::value_ptr(projection));
     glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "view"), 1, false, glm::value_ptr(view));
     glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "model"), 1, false, glm::value_ptr(model));
+    glUniform1i(glGetUniformLocation(shader.Program(), "texMap"), 0);
+    glUniform1i(glGetUniformLocation(shader.Program(), "snowCover"), 1);
+    glUniform1f(glGetUniformLocation(shader.Program(), "screenHeight"), float(screenHeight));
 
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, coverTexture);
+    glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
     glBindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
+
+// Loads a sprite on a white background into a texture with premultiplied alpha: near-white texels
+// become transparent, with a soft edge, so it can be blended without discarding fragments.
+GLuint loadSprite(const char* path)
+{
+    int width = 0, height = 0, channels = 0;
+    unsigned char* image = SOIL_load_image(path, &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (image == nullptr) {
+        std::cerr << "Error loading image '" << path << "'" << std::endl;
+        return 0;
+    }
+
+    // opaque below this sum of r + g + b, transparent above WHITE
+    constexpr float OPAQUE = 2.55f, WHITE = 2.7f;
+    std::vector<unsigned char> pixels(size_t(width) * height * 4);
+    for (int y = 0; y < height; y++) {
+        // flip, images are stored top row first
+        const unsigned char* src = image + size_t(height - 1 - y) * width * 4;
+        unsigned char* dst = pixels.data() + size_t(y) * width * 4;
+        for (int x = 0; x < width * 4; x += 4) {
+            const float sum = (src[x] + src[x + 1] + src[x + 2]) / 255.0f;
+            const float t = glm::clamp((sum - OPAQUE) / (WHITE - OPAQUE), 0.0f, 1.0f);
+            const float a = (1.0f - t * t * (3.0f - 2.0f * t)) * (src[x + 3] / 255.0f);
+            for (int c = 0; c < 3; c++) {
+                dst[x + c] = (unsigned char)(src[x + c] * a + 0.5f);
+            }
+            dst[x + 3] = (unsigned char)(a * 255.0f + 0.5f);
+        }
+    }
+    SOIL_free_image_data(image);
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+/* ======================== benchmarks (--bench) ======================== */
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchPool(JobSystem& jobs)
+{
+	// a full pool of 1M flakes that keeps emitting and retiring, without collisions, ground or wind
+	const int capacity = 1 << 20;
+	Snowing snow(0.3f, 0.0f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0}, capacity);
+	snow.SetCollisions(false);
+	snow.Scatter(capacity);
+
+	// warm up until every array and job queue has grown to its size
+	for (int k = 0; k < 30; k++) {
+		snow.Update(Snowing::TIMESTEP, jobs);
+	}
+
+	const int steps = 60;
+	const long long before = allocations.load();
+	const auto start = std::chrono::steady_clock::now();
+	for (int k = 0; k < steps; k++) {
+		snow.Update(Snowing::TIMESTEP, jobs);
+	}
+	const double ms = elapsedMs(start);
+	std::cout << "pool: " << snow.Count() << " flakes, " << ms / steps << " ms per step, "
+			  << snow.Count() * steps / ms * 1e-3 << " M flakes/s, "
+			  << allocations.load() - before << " allocations in " << steps << " steps" << std::endl;
+}
+
+void benchScaling()
+{
+	// the update with wind and collisions on 1 to 32 workers, without ground so the count stays the same
+	const int count = 1 << 17;
+	const int steps = 10;
+	double single = 0;
+	for (int workers = 1; workers <= 32; workers *= 2) {
+		JobSystem pool(workers);
+		Snowing snow(0.3f, 0.0f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0}, count);
+		snow.SetForceField(&wind);
+		snow.Scatter(count);
+		for (int k = 0; k < 5; k++) {
+			snow.Update(Snowing::TIMESTEP, pool);
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int k = 0; k < steps; k++) {
+			snow.Update(Snowing::TIMESTEP, pool);
+		}
+		const double ms = elapsedMs(start) / steps;
+		if (workers == 1) {
+			single = ms;
+		}
+		std::cout << "scaling: " << workers << " workers, " << snow.Count() << " flakes, "
+				  << ms << " ms per step, speedup " << single / ms << std::endl;
+	}
+}
+
+// FNV-1a of a block of memory
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t k = 0; k < size; k++) {
+		hash = (hash ^ bytes[k]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+void benchDeterminism()
+{
+	// the same seeded scene, with ground, wind and collisions, must end bit-identical on any number of workers
+	const int steps = 600;
+	uint64_t expected = 0;
+	for (int workers : {1, 2, 3, 8}) {
+		JobSystem pool(workers);
+		Heightfield cover(float(screenWidth), screenHeight / 3.0f);
+		Snowing snow(0.3f, 0.0f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0}, 1 << 16, 2021);
+		snow.SetGround(&cover);
+		snow.SetForceField(&wind);
+		snow.Scatter(1 << 15);
+		for (int k = 0; k < steps; k++) {
+			snow.Update(Snowing::TIMESTEP, pool);
+		}
+
+		const auto& drawn = snow.Drawn();
+		uint64_t hash = hashBytes(drawn.data(), drawn.size() * sizeof(glm::vec4));
+		hash = hashBytes(cover.Heights(), Heightfield::COLUMNS * sizeof(float), hash);
+		if (workers == 1) {
+			expected = hash;
+		}
+		std::cout << "determinism: " << workers << " workers, " << drawn.size() << " flakes after " << steps
+				  << " steps, hash " << std::hex << hash << std::dec << (hash == expected ? ", same" : ", DIFFERENT") << std::endl;
+	}
+}
+
+void benchGround(JobSystem& jobs)
+{
+	// cost of the ground test and the deposits at 1M flakes, with collisions and wind off;
+	// flakes landing on the cover die, so the cost is per flake and step
+	const int capacity = 1 << 20;
+	const int steps = 20;
+	double without = 0;
+	for (bool withGround : {false, true}) {
+		Heightfield cover(float(screenWidth), screenHeight / 3.0f);
+		Snowing snow(0.3f, 0.0f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0}, capacity);
+		snow.SetCollisions(false);
+		snow.SetGround(withGround ? &cover : nullptr);
+		snow.Scatter(capacity);
+		for (int k = 0; k < 5; k++) {
+			snow.Update(Snowing::TIMESTEP, jobs);
+		}
+
+		double ms = 0, flakeSteps = 0;
+		for (int k = 0; k < steps; k++) {
+			flakeSteps += snow.Count();
+			const auto start = std::chrono::steady_clock::now();
+			snow.Update(Snowing::TIMESTEP, jobs);
+			ms += elapsedMs(start);
+		}
+		const double ns = ms * 1e6 / flakeSteps;
+		if (!withGround) {
+			without = ns;
+		}
+		std::cout << "ground: " << (withGround ? "with" : "without") << " ground, " << snow.Count() << " flakes left, "
+				  << ms / steps << " ms per step, " << ns << " ns per flake";
+		if (withGround) {
+			std::cout << ", " << ns - without << " ns difference";
+		}
+		std::cout << std::endl;
+	}
+}
+
+void benchWind()
+{
+	// ForceField::Apply on 1M points on one thread, against a scalar loop over Wind() and Turbulence();
+	// with a step long enough that the drag is complete, both give the air velocity
+	const int n = 1 << 20;
+	const int runs = 10;
+	const float t = 7.3f, dt = 100.0f;
+	RandomStream random(2021, 0);
+	std::vector<float> posX(n), posY(n), velX(n), velY(n), refX(n), refY(n);
+	for (int i = 0; i < n; i++) {
+		const glm::vec4 u = random.At(uint64_t(i));
+		posX[i] = (u.x - 0.5f) * screenWidth;
+		posY[i] = (u.y - 0.5f) * screenHeight;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++) {
+		wind.Apply(0, n, t, dt, posX.data(), posY.data(), velX.data(), velY.data());
+	}
+	const double applyMs = elapsedMs(start) / runs;
+
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++) {
+		const glm::vec2 w = wind.Wind(t);
+		for (int i = 0; i < n; i++) {
+			const glm::vec2 air = w + wind.Turbulence(posX[i], posY[i], t);
+			refX[i] = air.x;
+			refY[i] = air.y;
+		}
+	}
+	const double scalarMs = elapsedMs(start) / runs;
+
+	float maxError = 0;
+	for (int i = 0; i < n; i++) {
+		maxError = std::max(maxError, std::max(std::abs(velX[i] - refX[i]), std::abs(velY[i] - refY[i])));
+	}
+#ifdef __AVX2__
+	const char* path = "AVX2";
+#else
+	const char* path = "scalar";
+#endif
+	std::cout << "wind: " << n << " points, Apply (" << path << ") " << applyMs << " ms, scalar loop " << scalarMs
+			  << " ms, max difference " << maxError << " px/s" << std::endl;
+}
+
+void benchFireworks()
+{
+	// 1M sparks in shells of 300, 10 s of 60 Hz frames; the bursts that fit in a 60 Hz frame budget
+	// are extrapolated from the measured time per frame
+	const int shells = (1 << 20) / 300;
+	const int frames = 600;
+	const float frameTime = 1.0f / 60;
+	FireWork show(shells, 300, screenWidth, screenHeight, 420.0f, 160.0f, {0, -200.0f}, 2.0f, 2021);
+	std::vector<FireWork::State> last(shells, FireWork::State::WAITING);
+	int bursts = 0;
+	double ms = 0;
+	for (int f = 0; f < frames; f++) {
+		const auto start = std::chrono::steady_clock::now();
+		show.Update(frameTime);
+		ms += elapsedMs(start);
+		for (int k = 0; k < shells; k++) {
+			const FireWork::State state = show.GetState(k);
+			bursts += state == FireWork::State::EXPLODED && last[k] != FireWork::State::EXPLODED;
+			last[k] = state;
+		}
+	}
+	const double perSecond = bursts / (frames * frameTime);
+	const double msPerFrame = ms / frames;
+	std::cout << "fireworks: " << shells * 300 << " sparks, " << msPerFrame << " ms per frame, " << perSecond
+			  << " bursts/s, " << perSecond * 1000.0 / 60 / msPerFrame << " bursts/s in a 60 Hz frame budget" << std::endl;
+}
+
+void benchGrid(JobSystem& jobs)
+{
+	// build and query at 100k and 1M points, spread over a square that holds 4 points per cell on average
+	const float cellSize = 20.0f;
+	for (int n : {100000, 1000000}) {
+		const float side = std::sqrt(n / 4.0f) * cellSize;
+		RandomStream random(2021, 1);
+		std::vector<float> x(n), y(n);
+		std::vector<int> neighbors(n);
+		for (int i = 0; i < n; i++) {
+			const glm::vec4 u = random.At(uint64_t(i));
+			x[i] = u.x * side;
+			y[i] = u.y * side;
+		}
+		SpatialGrid grid(cellSize, n);
+		grid.Build(x.data(), y.data(), n, jobs);
+
+		const int runs = 5;
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < runs; r++) {
+			grid.Build(x.data(), y.data(), n, jobs);
+		}
+		const double buildMs = elapsedMs(start) / runs;
+
+		// move the points into cell order, as the snow does before its queries
+		std::vector<float> sortedX(n), sortedY(n);
+		for (int k = 0; k < n; k++) {
+			sortedX[k] = x[grid.Order()[k]];
+			sortedY[k] = y[grid.Order()[k]];
+		}
+		x.swap(sortedX);
+		y.swap(sortedY);
+		grid.Reindexed();
+
+		start = std::chrono::steady_clock::now();
+		jobs.ParallelFor(n, 4096, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				int found = 0;
+				grid.ForEachNeighbor(x[i], y[i], [&](int j) {
+					const float dx = x[j] - x[i], dy = y[j] - y[i];
+					found += j != i && dx * dx + dy * dy < cellSize * cellSize;
+				});
+				neighbors[i] = found;
+			}
+		});
+		const double queryMs = elapsedMs(start);
+
+		long long total = 0;
+		for (int i = 0; i < n; i++) {
+			total += neighbors[i];
+		}
+		std::cout << "grid: " << n << " points, build " << buildMs << " ms, query " << queryMs << " ms, "
+				  << double(total) / n << " neighbours per point" << std::endl;
+	}
+}
+
+void benchSort(JobSystem& jobs)
+{
+	// 1M random 16-bit depth keys, radix sorted and with std::stable_sort, which must give the same order
+	const int n = 1 << 20;
+	const int runs = 10;
+	RandomStream random(2021, 2);
+	std::vector<uint16_t> keys(n);
+	for (int i = 0; i < n; i++) {
+		keys[i] = uint16_t(random.At(uint64_t(i)).x * 65535.0f);
+	}
+
+	RadixSorter sorter;
+	std::vector<uint16_t> sortedKeys;
+	std::vector<int> order(n);
+	double radixMs = 0;
+	for (int r = 0; r < runs; r++) {
+		sortedKeys = keys;
+		for (int i = 0; i < n; i++) {
+			order[i] = i;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		sorter.Sort(sortedKeys, order, jobs);
+		radixMs += elapsedMs(start);
+	}
+
+	std::vector<int> reference(n);
+	double stdMs = 0;
+	for (int r = 0; r < runs; r++) {
+		for (int i = 0; i < n; i++) {
+			reference[i] = i;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		std::stable_sort(reference.begin(), reference.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+		stdMs += elapsedMs(start);
+	}
+
+	std::cout << "sort: " << n << " keys, radix sort " << radixMs / runs << " ms, std::stable_sort " << stdMs / runs
+			  << " ms, " << (order == reference ? "same order" : "DIFFERENT ORDER") << std::endl;
+}
+
+void benchFill(JobSystem& jobs, const Shader& snowShader, GLuint texSnow, GLuint quadVBO)
+{
+	// 100k flakes over the window, drawn as in the scene with the premultiplied sprite,
+	// then with the raw sprite and the old discarding shader
+	const int n = 100000;
+	const int frames = 5;
+	auto discardShader = Shader::Create("snow.vert", "snowdiscard.frag");
+	const GLuint texRaw = SOIL_load_OGL_texture("snow.png", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y);
+	if (discardShader == nullptr || texRaw == 0) {
+		std::cerr << "fill: cannot load snowdiscard.frag or snow.png" << std::endl;
+		glDeleteTextures(1, &texRaw);
+		return;
+	}
+
+	Snowing snow(0.3f, 0.0f, screenWidth, screenHeight, {0, -4.0f, 0}, 12, 10, 50, {0, -9.8f, 0}, n);
+	snow.SetCollisions(false);
+	snow.Scatter(n);
+	snow.Update(Snowing::TIMESTEP, jobs);
+	snow.SetupBuffers(quadVBO);
+
+	const glm::mat4 view = glm::lookAt(glm::vec3{0, 0, 100}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+	const glm::mat4 projection = glm::ortho(-GLfloat(screenWidth) / 2, GLfloat(screenWidth) / 2,
+											-GLfloat(screenHeight) / 2, GLfloat(screenHeight) / 2, -1000.0f, 1000.0f);
+	GLuint query = 0;
+	glGenQueries(1, &query);
+	glViewport(0, 0, screenWidth, screenHeight);
+	glEnable(GL_BLEND);
+
+	for (bool premultiplied : {true, false}) {
+		const Shader& shader = premultiplied ? snowShader : *discardShader;
+		const GLuint texture = premultiplied ? texSnow : texRaw;
+		GLuint samples = 0;
+		double ms = 0;
+		for (int f = 0; f <= frames; f++) {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glFinish();
+			const auto start = std::chrono::steady_clock::now();
+			glBeginQuery(GL_SAMPLES_PASSED, query);
+			glDepthMask(GL_FALSE);
+			snow.Draw(shader, texture, view, projection);
+			glDepthMask(GL_TRUE);
+			glEndQuery(GL_SAMPLES_PASSED);
+			glFinish();
+			// the first frame warms up
+			ms += f > 0 ? elapsedMs(start) : 0.0;
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+		}
+		std::cout << "fill: " << n << " flakes, " << (premultiplied ? "premultiplied, no discard: " : "discard: ")
+				  << ms / frames << " ms per frame, " << samples << " samples, "
+				  << samples / (ms / frames) * 1e-3 << " M samples/s" << std::endl;
+	}
+
+	glDisable(GL_BLEND);
+	glDeleteQueries(1, &query);
+	glDeleteTextures(1, &texRaw);
+	snow.ReleaseBuffers();
+}
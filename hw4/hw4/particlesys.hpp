@@ -1,8 +1,9 @@
 #ifndef CG_PARTICLESYS_H_
 #define CG_PARTICLESYS_H_
 
-#include <stdlib.h>
+#include <vector>
 #include <cmath>
+#include <cstdint>
 
 #include <glad/glad.h>
 
@@ -10,209 +11,322 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "shader.hpp"
+#include "jobs.hpp"
+#include "random.hpp"
+
 namespace cg
 {
 
-const float PI = glm::pi<float>();
-
-class Mass
+/* A fixed number of point masses in the XY plane, each attribute in its own contiguous array.
+ * The updates are plain loops over the arrays, without branches, so the compiler can vectorize them.
+*/
+class BunchofMass
 {
-public:
-	double mass;
-	glm::vec3 position;
-	glm::vec3 speed;
-	glm::vec3 force;
-	double fadeSpeed;
-	double life;
+protected:
+	int massNum;
 
-public:
-	Mass() : mass(1.0f), position{0}, speed(0), force{0}, fadeSpeed(0), life(0) {}
+	AlignedVector<float> posX, posY;
+	AlignedVector<float> prevX, prevY;  // position before the last step
+	AlignedVector<float> velX, velY;
+	AlignedVector<float> alpha;
+	AlignedVector<float> fadeSpeed;
 
-	Mass(double mass, glm::vec3 position, glm::vec3 speed, double life) :
-		mass(mass), force{0}, position{position}, speed(speed),fadeSpeed(0), life(life)
+public:
+	explicit BunchofMass(int massNum) :
+		massNum(massNum),
+		posX(massNum), posY(massNum),
+		prevX(massNum), prevY(massNum),
+		velX(massNum), velY(massNum),
+		alpha(massNum, 0.0f),
+		fadeSpeed(massNum, 0.0f)
 	{
 	}
 
-	void Init()
-	{
-		force = glm::vec3(0.0, 0.0, 0.0);
-	}
+	virtual ~BunchofMass() { }
 
-	void Update(double dt)
-	{
-		speed += force / GLfloat(mass) * GLfloat(dt);
-		position += speed * GLfloat(dt);
-	}
+	int GetMassNum() const { return massNum; }
+
+	glm::vec2 GetPosition(int idx) const { return {posX[idx], posY[idx]}; }
+	glm::vec2 GetSpeed(int idx) const { return {velX[idx], velY[idx]}; }
+	float GetAlpha(int idx) const { return alpha[idx]; }
 
-	void ApplyForce(glm::vec3 newForce)
+	// Moves masses [begin, end) for a step of dt under a constant acceleration,
+	// with the speed damped by the factor damping per second.
+	void Integrate(int begin, int end, float dt, glm::vec2 acceleration, float damping)
 	{
-		this->force += newForce;
+		const float ax = acceleration.x * dt;
+		const float ay = acceleration.y * dt;
+		const float keep = std::pow(damping, dt);
+		for (int i = begin; i < end; i++) {
+			prevX[i] = posX[i];
+			prevY[i] = posY[i];
+			velX[i] = (velX[i] + ax) * keep;
+			velY[i] = (velY[i] + ay) * keep;
+			posX[i] += velX[i] * dt;
+			posY[i] += velY[i] * dt;
+		}
 	}
 
-	virtual void Apply() {}
-
-	void Process(double dt)
+	void Fade(int begin, int end, float dt)
 	{
-		Apply();
-		Update(dt);
+		for (int i = begin; i < end; i++) {
+			alpha[i] = glm::max(alpha[i] - fadeSpeed[i] * dt, 0.0f);
+		}
 	}
 };
 
-class BunchofMass
+/* Fireworks: a number of shells, each rising from the bottom of the window and bursting into sparks.
+ *
+ * All sparks of all shells live in one BunchofMass, shell k owning the sparks
+ * [k * sparks, (k + 1) * sparks). While a shell rises its sparks move together and only the first
+ * one is visible; when the shell slows down to the burst speed it explodes and the sparks fly apart
+ * and fade. Once they have faded out, the shell waits a random delay and is launched again
+ * from a new position with a new color.
+ *
+ * Like Snowing, it advances in fixed steps and draws positions interpolated between the last two.
+*/
+class FireWork : public BunchofMass
 {
-protected:
-	int massNum;
-	Mass** masses;
-
 public:
-	BunchofMass(int massNum, double m, glm::vec3 position, glm::vec3 speed, double life)
+	static constexpr float TIMESTEP = 1.0f / 120;
+	static constexpr int MAX_STEPS = 8;
+
+	enum class State : int
 	{
-		this->massNum = massNum;
-		masses = new Mass* [massNum];
-		if (masses) {
-			for (int i = 0; i < massNum; ++i) {
-				masses[i] = new Mass(m, position, speed, life);
-			}
+		WAITING,
+		RISING,
+		EXPLODED
+	};
+
+	// shells: number of shells, sparks: sparks per shell, launchSpeed: upwards speed of a new shell,
+	// burstSpeed: speed of the sparks, life: seconds until the sparks of a burst have faded out
+	FireWork(int shells, int sparks, int width, int height, float launchSpeed, float burstSpeed,
+			 glm::vec2 gravity, float life, uint64_t seed = 0) :
+		BunchofMass(shells * sparks),
+		shells(shells),
+		sparks(sparks),
+		width(width),
+		height(height),
+		launchSpeed(launchSpeed),
+		burstSpeed(burstSpeed),
+		gravity(gravity),
+		life(life),
+		accumulator(0),
+		state(shells, State::WAITING),
+		timer(shells),
+		color(shells),
+		random(shells),
+		VAO(0),
+		instanceVBO(0)
+	{
+		for (int k = 0; k < shells; k++) {
+			random[k].Seed(seed, uint32_t(k));
+			timer[k] = random[k].Next(0, 2.0f);
 		}
+		instances.reserve(massNum);
+		colors.reserve(massNum);
 	}
 
-	~BunchofMass()
+	virtual ~FireWork() { }
+
+	State GetState(int shell) const { return state[shell]; }
+
+	void SetPositionRange(int width, int height)
 	{
-		if (masses) {
-			for (int i = 0; i < massNum; ++i)
-				delete[] masses[i];
-			delete[] masses;
-		}
+		this->width = width;
+		this->height = height;
 	}
 
-	Mass* GetMass(int idx)
+	// Creates the GL objects for instanced drawing. The quad VBO holds <vec3 position, vec2 texCoord> vertices.
+	void SetupBuffers(GLuint quadVBO)
 	{
-		return masses[idx];
+		glGenVertexArrays(1, &VAO);
+		glBindVertexArray(VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(1);
+
+		// per-spark attributes: <vec2 offset, float size, float alpha> followed by all the colors
+		glGenBuffers(1, &instanceVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, massNum * (sizeof(glm::vec4) + sizeof(glm::vec3)), nullptr, GL_STREAM_DRAW);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)(massNum * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(3);
+		glVertexAttribDivisor(3, 1);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
 	}
 
-	void Init()
+	void ReleaseBuffers()
 	{
-		for (int i = 0; i < massNum; ++i)
-			masses[i]->Init(); //set force to zero
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &instanceVBO);
+		VAO = 0;
+		instanceVBO = 0;
 	}
 
-	virtual void Apply() {}
-
-	virtual void Update(double dt, glm::vec3 newpos)
+	void Update(float dt)
 	{
-		for (int i = 0; i < massNum; ++i)
-			masses[i]->Update(dt); //update speed and position
-								   // speed += (F/m) * dt
-								   // position += speed * dt
+		accumulator += dt;
+		int steps = 0;
+		while (accumulator >= TIMESTEP && steps < MAX_STEPS) {
+			step(TIMESTEP);
+			accumulator -= TIMESTEP;
+			steps++;
+		}
+		if (accumulator >= TIMESTEP) {
+			accumulator = std::fmod(accumulator, TIMESTEP);
+		}
+
+		// gather the visible sparks, in between the last two steps
+		const float blend = accumulator / TIMESTEP;
+		instances.clear();
+		colors.clear();
+		for (int k = 0; k < shells; k++) {
+			for (int i = k * sparks; i < (k + 1) * sparks; i++) {
+				if (alpha[i] > 0) {
+					const float x = prevX[i] + (posX[i] - prevX[i]) * blend;
+					const float y = prevY[i] + (posY[i] - prevY[i]) * blend;
+					instances.push_back(glm::vec4{x, y, SPARK_SIZE, alpha[i]});
+					colors.push_back(color[k]);
+				}
+			}
+		}
 	}
 
-	void Process(double dt, glm::vec3 newpos)
+	// Draws the sparks with additive blending, which is left enabled.
+	void Draw(const Shader& shader, const glm::mat4& view, const glm::mat4& projection) const
 	{
-		Init(); // set force to zero
-		Apply(); // apply force (add force)
-		Update(dt, newpos); // update speed and position
+		if (instances.empty()) {
+			return;
+		}
+
+		const GLsizeiptr count = GLsizeiptr(instances.size());
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, massNum * (sizeof(glm::vec4) + sizeof(glm::vec3)), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec4), instances.data());
+		glBufferSubData(GL_ARRAY_BUFFER, massNum * sizeof(glm::vec4), count * sizeof(glm::vec3), colors.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		shader.Use();
+		glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
+		glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+		glBindVertexArray(VAO);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, GLsizei(count));
+		glBindVertexArray(0);
 	}
-};
 
-class FireWork : public BunchofMass
-{
-	glm::vec3 gravAcceleratio, constGravAcceleratio;
-	double lifeLeft;
+private:
+	static constexpr float SPARK_SIZE = 6.0f;
+	// fraction of the speed kept after a second
+	static constexpr float SPARK_DAMPING = 0.4f;
 
-	glm::vec3 initialSpeed;
-	glm::vec3 initialPosition;
-	double initialLife;
+	int shells;
+	int sparks;
+	int width;
+	int height;
+	float launchSpeed;
+	float burstSpeed;
+	glm::vec2 gravity;
+	float life;
 
-public:
-	bool hasExploded;
+	float accumulator;
 
-public:
-	FireWork(int massNum, double m, glm::vec3 position, glm::vec3 speed,
-			 glm::vec3 gravity, double lifeValue)
-		: BunchofMass(massNum, m, position, speed, lifeValue), hasExploded(false)
-	{
-		gravAcceleratio = gravity;
-		constGravAcceleratio = gravity;
-		lifeLeft = lifeValue;
-
-		initialPosition = position;
-		initialSpeed = speed;
-		initialLife = lifeLeft;
-
-		double r = rand() % 255;
-		double g = rand() % 255;
-		double b = rand() % 255;
-		for (int i = 0; i < massNum; ++i) 		{
-			masses[i]->color = glm::vec4(r / 255., g / 255., b / 255., 1.0);
-			masses[i]->fadeSpeed = rand() % 2 ? 50 / 255. : 40 / 255.;
-			masses[i]->life = lifeLeft;
-		}
-	}
+	std::vector<State> state;
+	std::vector<float> timer;
+	std::vector<glm::vec3> color;
+	std::vector<RandomStream> random;
 
-	~FireWork()
-	{
-	}
+	// visible sparks to draw
+	std::vector<glm::vec4> instances;
+	std::vector<glm::vec3> colors;
+
+	GLuint VAO;
+	GLuint instanceVBO;
 
-	int GetMassNum()
+	void step(float dt)
 	{
-		return massNum;
+		for (int k = 0; k < shells; k++) {
+			const int begin = k * sparks, end = begin + sparks;
+			switch (state[k]) {
+			case State::WAITING:
+				timer[k] -= dt;
+				if (timer[k] < 0) {
+					launch(k);
+				}
+				break;
+			case State::RISING:
+				Integrate(begin, end, dt, gravity, 1.0f);
+				if (velY[begin] < 0.2f * launchSpeed) {
+					explode(k);
+				}
+				break;
+			case State::EXPLODED:
+				Integrate(begin, end, dt, gravity, SPARK_DAMPING);
+				Fade(begin, end, dt);
+				timer[k] -= dt;
+				if (timer[k] < 0) {
+					state[k] = State::WAITING;
+					timer[k] = random[k].Next(0.2f, 1.5f);
+				}
+				break;
+			}
+		}
 	}
 
-	virtual void Apply()
+	void launch(int k)
 	{
-		for (int i = 0; i < massNum; ++i) // apply gravity
-		{
-			masses[i]->ApplyForce(gravAcceleratio * GLfloat(masses[i]->mass));
+		auto& rng = random[k];
+		const float x = rng.Next(-0.4f, 0.4f) * float(width);
+		const float y = -float(height) / 2;
+		const float vx = rng.Next(-0.1f, 0.1f) * launchSpeed;
+		const float vy = rng.Next(0.85f, 1.0f) * launchSpeed;
+
+		// bright, saturated colors
+		const float hue = rng.Next() * 2 * glm::pi<float>();
+		color[k] = glm::vec3{std::cos(hue), std::cos(hue + glm::radians(120.0f)), std::cos(hue - glm::radians(120.0f))} * 0.5f + 0.5f;
+
+		for (int i = k * sparks; i < (k + 1) * sparks; i++) {
+			posX[i] = prevX[i] = x;
+			posY[i] = prevY[i] = y;
+			velX[i] = vx;
+			velY[i] = vy;
+			alpha[i] = 0.0f;
+			fadeSpeed[i] = 0.0f;
 		}
+		// the shell itself
+		alpha[k * sparks] = 1.0f;
 
-		if (!hasExploded && masses[0]->speed[1] < 10) // time to explode
-		{
-			for (int i = 0; i < massNum; ++i) // simulate uniform spray
-			{
-				double radius = rand() % 30;
-				double angle1 = rand() % 360;
-				double angle2 = rand() % 360;
-
-				//a random direction
-				glm::vec3 dir = glm::vec3(radius * cos(angle2 * PI / 180) * cos(angle1 * PI / 180),
-										  radius * cos(angle2 * PI / 180) * sin(angle1 * PI / 180),
-										  radius * sin(angle2 * PI / 180));
-				dir = glm::normalize(dir);
-				dir *= 10;
-
-				gravAcceleratio = glm::vec3(0, 0, 0);
-				masses[i]->speed = glm::vec3(0, 0, 0);
-				masses[i]->speed += dir;
-				hasExploded = true;
-			}
-		}
+		state[k] = State::RISING;
 	}
 
-	virtual void Update(double dt, glm::vec3 newPos)
+	void explode(int k)
 	{
-		BunchofMass::Update(dt, newPos); // update speed and position
-		lifeLeft -= dt;
-
-		if (hasExploded) 		{
-			for (int i = 0; i < massNum; ++i) {
-				masses[i]->color.a -= masses[i]->fadeSpeed * dt; // here alpha is transparency
-				if (masses[i]->color.a < 0) masses[i]->color.a = 0;
-			}
-		}
-		if (lifeLeft < 1e-2) // revive
-		{
-			double r = rand() % 255;
-			double g = rand() % 255;
-			double b = rand() % 255;
-			for (int i = 0; i < massNum; ++i) {
-				masses[i]->speed = initialSpeed;
-				masses[i]->color = glm::vec4(r / 255., g / 255., b / 255., 1.0);
-				masses[i]->position = newPos;
-			}
-			gravAcceleratio = constGravAcceleratio;
-			lifeLeft = initialLife;
-			hasExploded = false;
+		auto& rng = random[k];
+		for (int i = k * sparks; i < (k + 1) * sparks; i++) {
+			// a uniform direction on the sphere, seen from the side
+			const float z = rng.Next(-1, 1);
+			const float phi = rng.Next() * 2 * glm::pi<float>();
+			const float r = std::sqrt(1 - z * z);
+			const float speed = burstSpeed * rng.Next(0.9f, 1.1f);
+			velX[i] += r * std::cos(phi) * speed;
+			velY[i] += r * std::sin(phi) * speed;
+			alpha[i] = 1.0f;
+			fadeSpeed[i] = 1.0f / (life * (rng.Next() < 0.5f ? 0.8f : 1.0f));
 		}
+
+		state[k] = State::EXPLODED;
+		timer[k] = life;
 	}
 };
 
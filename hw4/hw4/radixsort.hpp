@@ -0,0 +1,94 @@
+#ifndef CG_RADIXSORT_H_
+#define CG_RADIXSORT_H_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "jobs.hpp"
+
+namespace cg
+{
+
+/* Stable parallel LSD radix sort of values by 16-bit keys, in two passes of 8 bits.
+ * In each pass every chunk counts its keys per digit, the counts are turned into write
+ * offsets (digit-major, chunk-minor) and every chunk scatters its items. A pass in which all
+ * keys share the same digit is skipped. The buffers are kept between calls.
+*/
+class RadixSorter
+{
+public:
+	static constexpr int RADIX_BITS = 8;
+	static constexpr int BUCKETS = 1 << RADIX_BITS;
+	static constexpr int PASSES = 16 / RADIX_BITS;
+
+	// Sorts values by keys, permuting both.
+	void Sort(std::vector<uint16_t>& keys, std::vector<int>& values, JobSystem& jobs)
+	{
+		const int n = int(keys.size());
+		const int numChunks = std::max(1, std::min(jobs.Workers(), n / MIN_CHUNK));
+		const int chunkSize = (n + numChunks - 1) / numChunks;
+
+		tmpKeys.resize(n);
+		tmpValues.resize(n);
+		counts.resize(size_t(numChunks) * BUCKETS);
+
+		for (int pass = 0; pass < PASSES; pass++) {
+			const int shift = pass * RADIX_BITS;
+
+			jobs.ParallelFor(numChunks, 1, [&](int begin, int end) {
+				for (int c = begin; c < end; c++) {
+					int* count = &counts[size_t(c) * BUCKETS];
+					std::fill(count, count + BUCKETS, 0);
+					const int last = std::min(n, (c + 1) * chunkSize);
+					for (int i = c * chunkSize; i < last; i++) {
+						count[(keys[i] >> shift) & (BUCKETS - 1)]++;
+					}
+				}
+			});
+
+			int offset = 0;
+			bool trivial = false;
+			for (int d = 0; d < BUCKETS; d++) {
+				int total = 0;
+				for (int c = 0; c < numChunks; c++) {
+					int& count = counts[size_t(c) * BUCKETS + d];
+					const int num = count;
+					count = offset;
+					offset += num;
+					total += num;
+				}
+				trivial = trivial || total == n;
+			}
+			if (trivial) {
+				continue;
+			}
+
+			jobs.ParallelFor(numChunks, 1, [&](int begin, int end) {
+				for (int c = begin; c < end; c++) {
+					int* offset = &counts[size_t(c) * BUCKETS];
+					const int last = std::min(n, (c + 1) * chunkSize);
+					for (int i = c * chunkSize; i < last; i++) {
+						const int dst = offset[(keys[i] >> shift) & (BUCKETS - 1)]++;
+						tmpKeys[dst] = keys[i];
+						tmpValues[dst] = values[i];
+					}
+				}
+			});
+			keys.swap(tmpKeys);
+			values.swap(tmpValues);
+		}
+	}
+
+private:
+	// items per chunk at least
+	static constexpr int MIN_CHUNK = 16384;
+
+	std::vector<uint16_t> tmpKeys;
+	std::vector<int> tmpValues;
+	std::vector<int> counts;        // per chunk and digit: count, then write offset
+};
+
+} /* namespace cg */
+
+#endif /* CG_RADIXSORT_H_ */
@@ -0,0 +1,98 @@
+#ifndef CG_RANDOM_H_
+#define CG_RANDOM_H_
+
+#include <array>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace cg
+{
+
+/* Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+ * The output is a pure function of a 128-bit counter and a 64-bit key, so any number of the
+ * sequence can be computed directly, on any thread, without shared state.
+*/
+struct Philox
+{
+	using Counter = std::array<uint32_t, 4>;
+	using Key = std::array<uint32_t, 2>;
+
+	static constexpr int ROUNDS = 10;
+
+	static Counter Generate(Counter ctr, Key key)
+	{
+		for (int r = 0; r < ROUNDS; r++) {
+			const uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+			const uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+			ctr = {
+				uint32_t(p1 >> 32) ^ ctr[1] ^ key[0],
+				uint32_t(p1),
+				uint32_t(p0 >> 32) ^ ctr[3] ^ key[1],
+				uint32_t(p0)
+			};
+			key[0] += 0x9E3779B9u;
+			key[1] += 0xBB67AE85u;
+		}
+		return ctr;
+	}
+
+	// maps the upper 24 bits to [0, 1)
+	static float ToFloat(uint32_t bits)
+	{
+		return float(bits >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+/* A seedable random stream, e.g. one per emitter.
+ * Block i of stream s under seed k is Philox({i, i >> 32, s, 0}, k), so streams never overlap.
+ * Use At() to tie numbers to an event (a particle's serial number), or Next() for sequential draws.
+*/
+class RandomStream
+{
+public:
+	explicit RandomStream(uint64_t seed = 0, uint32_t stream = 0) :
+		key_{uint32_t(seed), uint32_t(seed >> 32)}, stream_(stream), next_(0), lane_(4) { }
+
+	void Seed(uint64_t seed, uint32_t stream)
+	{
+		key_ = {uint32_t(seed), uint32_t(seed >> 32)};
+		stream_ = stream;
+		next_ = 0;
+		lane_ = 4;
+	}
+
+	// Four independent uniform numbers in [0, 1) for the given index.
+	glm::vec4 At(uint64_t index) const
+	{
+		const auto bits = Philox::Generate({uint32_t(index), uint32_t(index >> 32), stream_, 0}, key_);
+		return glm::vec4{Philox::ToFloat(bits[0]), Philox::ToFloat(bits[1]), Philox::ToFloat(bits[2]), Philox::ToFloat(bits[3])};
+	}
+
+	// The next uniform number in [0, 1) of the sequence.
+	float Next()
+	{
+		if (lane_ == 4) {
+			block_ = At(next_++);
+			lane_ = 0;
+		}
+		return block_[lane_++];
+	}
+
+	float Next(float lo, float hi)
+	{
+		return lo + (hi - lo) * Next();
+	}
+
+private:
+	Philox::Key key_;
+	uint32_t stream_;
+
+	uint64_t next_;
+	glm::vec4 block_;
+	int lane_;
+};
+
+} /* namespace cg */
+
+#endif /* CG_RANDOM_H_ */
@@ -5,17 +5,27 @@
 #version 330 core
 
 in vec2 mapCoord;
+in vec2 worldPos;
+in float flakeAlpha;
 
 out vec4 color;
 
+// premultiplied alpha, blended with (ONE, ONE_MINUS_SRC_ALPHA)
 uniform sampler2D texMap;
-uniform float alpha;
+// depth of the snow cover in pixels, one texel per column
+uniform sampler2D snowCover;
+uniform float coverWidth;
+uniform float screenHeight;
+// pixels above the snow cover over which a flake fades in, 0 for no fading
+uniform float softEdge;
 
 void main()
 {
-	color = texture(texMap, mapCoord);
-    if (color.r + color.g + color.b >= 2.7f) {
-        discard;
-    }
-    color.a = alpha;
+	float fade = flakeAlpha;
+	if (softEdge > 0.0f) {
+		float cover = texture(snowCover, vec2(worldPos.x / coverWidth + 0.5f, 0.5f)).r;
+		float above = worldPos.y + screenHeight / 2.0f - cover;
+		fade *= clamp(above / softEdge, 0.0f, 1.0f);
+	}
+	color = texture(texMap, mapCoord) * fade;
 }
@@ -1,7 +1,10 @@
 #ifndef CG_SNOW_H_
 #define CG_SNOW_H_
 
-#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 #include <glad/glad.h>
 
@@ -10,67 +13,114 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.hpp"
+#include "jobs.hpp"
+#include "random.hpp"
+#include "heightfield.hpp"
+#include "forcefield.hpp"
+#include "spatialgrid.hpp"
+#include "radixsort.hpp"
 
 namespace cg
 {
 
 const float PI = glm::pi<float>();
 
-class Mass
+/* A snowfall emitter backed by a fixed-capacity particle pool.
+ * Every attribute lives in its own contiguous array allocated once in the constructor,
+ * and the first Count() entries are the live flakes. A dead flake is retired by moving
+ * the last live flake into its slot, so nothing is allocated after warm-up and a
+ * long-lived flake never blocks the recycling of others.
+ *
+ * The update runs on a JobSystem: the arrays are split into cache-line aligned chunks that
+ * are integrated in parallel, then retirement and emission are done serially in a fixed order,
+ * so the result does not depend on the number of threads. The flakes to draw are copied into
+ * one of two instance buffers, so a frame can be drawn while the next one is simulated.
+ *
+ * The simulation advances in fixed steps and the drawn positions are interpolated between
+ * the last two steps. Random numbers come from a counter-based stream indexed by the serial
+ * number of the emitted flake, so a given seed always gives the same snowfall.
+ *
+ * With a ground heightfield set, a flake that touches the snow cover dies and adds its snow
+ * to the cover. The deposits are gathered per chunk and added after the parallel part.
+ * With a force field set, flakes are also carried by its wind and turbulence.
+ *
+ * Flakes that touch each other stick together: each step the flakes are sorted into a spatial
+ * grid and the arrays are reordered by grid cell, then every flake looks for touching neighbours
+ * and loses its speed towards them.
+ *
+ * Bigger flakes are nearer to the viewer. The flakes are blended without writing depth, so they
+ * are drawn back to front: every frame the flakes are sorted by a 16-bit depth key, starting from
+ * the order of the last frame. Each flake keeps an id for its life for this. The flakes that were
+ * drawn last frame are usually still in order and only the new ones are merged in; otherwise
+ * all of them are radix sorted.
+*/
+class Snowing
 {
-protected:
-	glm::vec3 speed;
-	float fadeSpeed;
-	glm::vec3 force;
-
 public:
-	float mass;
-	float life;
-	glm::vec3 position;
-	float alpha;
-	float scale;
-
-	Mass(float mass, glm::vec3 position, glm::vec3 speed, float life, float scale)
-	{
-		Init(mass, position, speed, life, scale);
-	}
-
-	void Init(float mass, glm::vec3 position, glm::vec3 speed, float life, float scale)
-	{
-		this->life = life;
-		this->force = glm::vec3{0};
-		this->speed = speed;
-		this->position = position;
-		this->scale = scale;
-		fadeSpeed = 1.0f / life;
-		alpha = 1.0f;
-	}
-
-	void ApplyForce(glm::vec3 newForce)
-	{
-		this->force += newForce;
-	}
+	// flakes per job, a multiple of the floats in a cache line
+	static constexpr int CHUNK_SIZE = 4096;
+	// simulation step in seconds
+	static constexpr float TIMESTEP = 1.0f / 120;
+	// steps per update at most, the rest of a long frame is dropped
+	static constexpr int MAX_STEPS = 8;
 
-	virtual void Update(float dt)
+private:
+	// flake state, only the first count entries are live
+	AlignedVector<float> posX, posY;
+	AlignedVector<float> prevX, prevY;  // position before the last step
+	AlignedVector<float> velX, velY;
+	AlignedVector<float> life;
+	AlignedVector<float> alpha;
+	AlignedVector<float> fadeSpeed;
+	AlignedVector<float> scale;
+	std::vector<int> id;    // stays with the flake while it lives
+
+	// part of a flake's size that collides
+	static constexpr float COLLISION_RADIUS = 0.3f;
+
+	SpatialGrid grid;
+	bool collisions;
+
+	// spare arrays to reorder and collide into
+	AlignedVector<float> scratch;
+	AlignedVector<float> newVelX, newVelY;
+	std::vector<int> idScratch;
+
+	// what each chunk found in the last step
+	struct ChunkResult
 	{
-		speed += force / GLfloat(mass) * GLfloat(dt);
-		position += speed * GLfloat(dt);
-		alpha -= fadeSpeed * dt;
-		if (alpha < 0) {
-			alpha = 0;
-		}
-		life -= dt;
-	}
-};
-
-class Snowing
-{
-	std::deque<Mass*> available;
-	std::deque<Mass*> emitted;
+		std::vector<int> dead;
+		std::vector<Deposit> deposits;
+	};
+	std::vector<ChunkResult> chunks;
+
+	// depth sorting
+	std::vector<int> freeIds;
+	std::vector<int> slotOf;        // index of the flake with each id
+	std::vector<uint32_t> seen;     // frame in which each id was found in the last order
+	uint32_t frame;
+	std::vector<int> lastOrder;     // ids of the flakes drawn last frame, back to front
+	std::vector<int> drawOrder;     // flake indices to draw, back to front
+	std::vector<uint16_t> depthKeys;
+	std::vector<int> mergeOrder;
+	RadixSorter sorter;
+
+	Heightfield* ground;
+	float softEdge;     // pixels above the ground over which flakes fade in
+	const ForceField* field;
+	float time;     // simulated time
+
+	// <vec2 offset, float scale, float alpha> of each flake to draw, double buffered
+	std::vector<glm::vec4> instances[2];
+	int front;
+
+	int capacity;
+	int budget;
+	int count;
+	int throttled;
 
 	float period;
 	float growth;
-	float massMass;
 	float minScale;
 	float maxScale;
 	float initLife;
@@ -80,120 +130,530 @@ class Snowing
 	glm::vec3 gravity;
 
 	float countdown;
+	float accumulator;
+
+	RandomStream random;
+	uint64_t serial;
+
+	JobSystem* jobs;
+	JobCounter pending;
+	float pendingDt;
+	bool stepping;
+
+	GLuint VAO;
+	GLuint instanceVBO;
 
 public:
-	Snowing(float period, float growth, float m, int width, int height,
-			glm::vec3 speed, float life, float minScale, float maxScale, glm::vec3 gravity) :
+	Snowing(float period, float growth, int width, int height, glm::vec3 speed,
+			float life, float minScale, float maxScale, glm::vec3 gravity, int capacity, uint64_t seed = 0) :
+		grid(2 * maxScale * COLLISION_RADIUS, capacity),
+		collisions(true),
+		frame(0),
+		ground(nullptr),
+		softEdge(0),
+		field(nullptr),
+		time(0),
+		front(0),
+		capacity(capacity),
+		budget(capacity),
+		count(0),
+		throttled(0),
 		period(period),
 		growth(growth),
-		massMass(m),
 		minScale(minScale),
 		maxScale(maxScale),
 		initLife(life),
-		width(width),
 		height(height),
+		width(width),
 		initSpeed(speed),
-		gravity(gravity)
+		gravity(gravity),
+		countdown(0),
+		accumulator(0),
+		random(seed),
+		serial(0),
+		jobs(nullptr),
+		pendingDt(0),
+		stepping(false),
+		VAO(0),
+		instanceVBO(0)
+	{
+		posX.resize(capacity);
+		posY.resize(capacity);
+		prevX.resize(capacity);
+		prevY.resize(capacity);
+		velX.resize(capacity);
+		velY.resize(capacity);
+		this->life.resize(capacity);
+		alpha.resize(capacity);
+		fadeSpeed.resize(capacity);
+		scale.resize(capacity);
+		id.resize(capacity);
+		scratch.resize(capacity);
+		idScratch.resize(capacity);
+		newVelX.resize(capacity);
+		newVelY.resize(capacity);
+
+		for (int k = capacity - 1; k >= 0; k--) {
+			freeIds.push_back(k);
+		}
+		slotOf.resize(capacity, 0);
+		seen.resize(capacity, 0);
+		lastOrder.reserve(capacity);
+		drawOrder.reserve(capacity);
+		depthKeys.reserve(capacity);
+		mergeOrder.reserve(capacity);
+
+		instances[0].reserve(capacity);
+		instances[1].reserve(capacity);
+	}
+
+	virtual ~Snowing() { }
+
+	// The state accessors must not be called while an update is running (see StartUpdate).
+	int Count() const { return count; }
+	int Capacity() const { return capacity; }
+	int Budget() const { return budget; }
+
+	// Number of flakes dropped so far because the budget was reached.
+	int Throttled() const { return throttled; }
+
+	// Instances <offset, scale, alpha> of the drawn state, in drawing order.
+	const std::vector<glm::vec4>& Drawn() const { return instances[front]; }
+
+	// Limits the number of live flakes, at most the capacity of the pool.
+	void SetBudget(int maxParticles)
 	{
-		countdown = 0;
+		budget = glm::clamp(maxParticles, 0, capacity);
 	}
 
-	virtual ~Snowing()
+	void SetPositionRange(int width, int height)
 	{
-		for (auto& p : emitted) {
-			if (p) {
-				delete p;
-			}
+		this->width = width;
+		this->height = height;
+	}
+
+	// Flakes landing on the ground add to this heightfield, nullptr to let them fall through.
+	void SetGround(Heightfield* heightfield)
+	{
+		ground = heightfield;
+	}
+
+	// Fades flakes in over this many pixels above the ground instead of cutting them off at it, 0 to turn off.
+	void SetSoftEdge(float pixels)
+	{
+		softEdge = pixels;
+	}
+
+	float SoftEdge() const { return softEdge; }
+
+	void SetCollisions(bool enabled)
+	{
+		collisions = enabled;
+	}
+
+	bool Collisions() const { return collisions; }
+
+	// Wind and turbulence to carry the flakes, nullptr for still air.
+	void SetForceField(const ForceField* forceField)
+	{
+		field = forceField;
+	}
+
+	// Emits up to n flakes at random heights over the window, as if it had been snowing for a while.
+	// Must not be called while an update is running.
+	void Scatter(int n)
+	{
+		for (int k = 0; k < n && count < budget; k++) {
+			const glm::vec4 u = random.At(serial++);
+			emit(u);
+			posY[count - 1] = u.z * float(height) - float(height) / 2;
+			prevY[count - 1] = posY[count - 1];
 		}
+	}
 
-		for (auto& p : available) {
-			if (p) {
-				delete p;
-			}
+	// Creates the GL objects for instanced drawing. The quad VBO holds <vec3 position, vec2 texCoord> vertices.
+	void SetupBuffers(GLuint quadVBO)
+	{
+		glGenVertexArrays(1, &VAO);
+		glBindVertexArray(VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(1);
+
+		// per-flake attributes
+		glGenBuffers(1, &instanceVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+
+	void ReleaseBuffers()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &instanceVBO);
+		VAO = 0;
+		instanceVBO = 0;
+	}
+
+	// Starts advancing the simulation by the frame time on the job system and returns immediately.
+	// Until FinishUpdate() returns, only Draw() may be called.
+	void StartUpdate(float dt, JobSystem& jobSystem)
+	{
+		jobs = &jobSystem;
+		pendingDt = dt;
+		stepping = true;
+		jobs->Submit(&advanceJob, this, 0, 0, pending);
+	}
+
+	// Waits for the update started by StartUpdate(), then makes its result the one to draw.
+	void FinishUpdate()
+	{
+		if (!stepping) {
+			return;
 		}
+		jobs->Wait(pending);
+		stepping = false;
+		front = 1 - front;
 	}
 
-	const Mass* GetMass(int idx) const
+	void Update(float dt, JobSystem& jobSystem)
 	{
-		return emitted[idx];
+		StartUpdate(dt, jobSystem);
+		FinishUpdate();
 	}
 
-	void SetPositionRange(int width, int height)
+	// Draws the flakes back to front with premultiplied alpha blending, which is left enabled.
+	// The texture must have premultiplied alpha. Depth writes should be off.
+	virtual void Draw(const Shader& shader, GLuint texture, const glm::mat4& view, const glm::mat4& projection) const
 	{
-		this->width = width;
-		this->height = height;
+		const auto& drawn = instances[front];
+		if (drawn.empty()) {
+			return;
+		}
+
+		// orphan the old storage, the GPU may still be reading it
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, drawn.size() * sizeof(glm::vec4), drawn.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		shader.Use();
+		glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
+		glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+		glUniform1i(glGetUniformLocation(shader.Program(), "texMap"), 0);
+		glUniform1i(glGetUniformLocation(shader.Program(), "snowCover"), 1);
+		glUniform1f(glGetUniformLocation(shader.Program(), "softEdge"), ground != nullptr ? softEdge : 0.0f);
+		if (ground != nullptr) {
+			glUniform1f(glGetUniformLocation(shader.Program(), "coverWidth"), ground->Width());
+			glUniform1f(glGetUniformLocation(shader.Program(), "screenHeight"), float(height));
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, ground->Texture());
+			glActiveTexture(GL_TEXTURE0);
+		}
+
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glBindVertexArray(VAO);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, GLsizei(drawn.size()));
+		glBindVertexArray(0);
+	}
+
+private:
+	static void advanceJob(void* context, int, int)
+	{
+		auto self = static_cast<Snowing*>(context);
+		self->advance(self->pendingDt);
+	}
+
+	void advance(float frameDt)
+	{
+		accumulator += frameDt;
+		int steps = 0;
+		while (accumulator >= TIMESTEP && steps < MAX_STEPS) {
+			step(TIMESTEP);
+			accumulator -= TIMESTEP;
+			steps++;
+		}
+		if (accumulator >= TIMESTEP) {
+			accumulator = fmod(accumulator, TIMESTEP);
+		}
+
+		sortByDepth();
+
+		// copy the result into the instance buffer which is not being drawn, in drawing order,
+		// interpolated between the last two steps by the time left over
+		const float blend = accumulator / TIMESTEP;
+		auto& back = instances[1 - front];
+		back.resize(count);
+		jobs->ParallelFor(count, CHUNK_SIZE, [this, &back, blend](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				const int i = drawOrder[k];
+				const float x = prevX[i] + (posX[i] - prevX[i]) * blend;
+				const float y = prevY[i] + (posY[i] - prevY[i]) * blend;
+				back[k] = glm::vec4{x, y, scale[i], alpha[i]};
+			}
+		});
+	}
+
+	// quantized depth of a flake, larger is nearer
+	uint16_t depthKey(int i) const
+	{
+		const float range = maxScale - minScale;
+		const float t = range > 0 ? (scale[i] - minScale) / range : 0.0f;
+		return uint16_t(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
 	}
 
-	void Update(float dt)
+	// fills drawOrder with the live flakes from far to near
+	void sortByDepth()
 	{
-		for (auto& m : emitted) {
-			m->Update(dt);
+		// the flakes drawn last frame that are still alive, in last frame's order, then the new ones;
+		// an id freed and taken again since is caught by the sortedness check below
+		frame++;
+		for (int i = 0; i < count; i++) {
+			slotOf[id[i]] = i;
+		}
+		drawOrder.clear();
+		for (int fid : lastOrder) {
+			const int i = slotOf[fid];
+			if (i < count && id[i] == fid) {
+				drawOrder.push_back(i);
+				seen[fid] = frame;
+			}
+		}
+		const int kept = int(drawOrder.size());
+		for (int i = 0; i < count; i++) {
+			if (seen[id[i]] != frame) {
+				drawOrder.push_back(i);
+			}
 		}
 
-		// check dead mass
-		while (emitted.size() > 0 && emitted.front()->life < 1e-2) {
-			auto& front = emitted.front();
-			emitted.pop_front();
-			available.push_back(front);
+		depthKeys.resize(count);
+		for (int k = 0; k < count; k++) {
+			depthKeys[k] = depthKey(drawOrder[k]);
 		}
 
-		// gen new mass
+		bool presorted = true;
+		for (int k = 1; k < kept && presorted; k++) {
+			presorted = depthKeys[k - 1] <= depthKeys[k];
+		}
+		if (presorted && (count - kept) * 8 <= count) {
+			// sort the few new flakes and merge them in, kept flakes first among equal keys
+			const auto byKey = [this](int a, int b) { return depthKey(a) < depthKey(b); };
+			std::stable_sort(drawOrder.begin() + kept, drawOrder.end(), byKey);
+			mergeOrder.resize(count);
+			std::merge(drawOrder.begin(), drawOrder.begin() + kept, drawOrder.begin() + kept, drawOrder.end(),
+					   mergeOrder.begin(), byKey);
+			drawOrder.swap(mergeOrder);
+		} else {
+			sorter.Sort(depthKeys, drawOrder, *jobs);
+		}
+
+		lastOrder.resize(count);
+		for (int k = 0; k < count; k++) {
+			lastOrder[k] = id[drawOrder[k]];
+		}
+	}
+
+	void step(float dt)
+	{
+		if (collisions && count > 1) {
+			collide();
+		}
+
+		const int n = count;
+		const int numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		while (int(chunks.size()) < numChunks) {
+			chunks.emplace_back();
+			chunks.back().dead.reserve(CHUNK_SIZE);
+			chunks.back().deposits.reserve(CHUNK_SIZE);
+		}
+
+		jobs->ParallelFor(n, CHUNK_SIZE, [this, dt](int begin, int end) {
+			integrate(begin, end, dt, chunks[begin / CHUNK_SIZE]);
+		});
+
+		if (ground != nullptr) {
+			for (int c = 0; c < numChunks; c++) {
+				ground->Apply(chunks[c].deposits);
+			}
+			ground->Settle();
+		}
+
+		// retire dead flakes from the highest index down, so the last live flake is never a dead one
+		for (int c = numChunks - 1; c >= 0; c--) {
+			const auto& dead = chunks[c].dead;
+			for (int k = int(dead.size()) - 1; k >= 0; k--) {
+				retire(dead[k]);
+			}
+		}
+
+		// gen new flakes, several per step if the period is shorter than a step
 		countdown -= dt;
-		if (countdown < 0) {
-			auto newOne = newMass();
-			newOne->ApplyForce(gravity * newOne->mass);
-			emitted.push_back(newOne);
-			countdown = float(rand() % int(period * 100)) / 100;
+		while (countdown < 0) {
+			const glm::vec4 u = random.At(serial++);
+			if (count < budget) {
+				emit(u);
+			} else {
+				throttled++;
+			}
+			countdown += u.w * period;
 		}
 
 		period -= growth * dt;
 		if (period < 0.3f) {
 			period = 0.3f;
 		}
+
+		time += dt;
 	}
 
-	virtual void Draw(const Shader& shader, GLuint VAO, GLuint texture, const glm::mat4& view, const glm::mat4& projection) const
+	void collide()
 	{
-		for (auto& mass : emitted) {
-			drawMass(mass, shader, VAO, texture, view, projection);
-		}
+		grid.Build(posX.data(), posY.data(), count, *jobs);
+		reorder(grid.Order());
+		grid.Reindexed();
+
+		// every flake only changes its own speed, from the speeds before this pass
+		jobs->ParallelFor(count, CHUNK_SIZE, [this](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				float vx = velX[i], vy = velY[i];
+				const float ri = scale[i] * COLLISION_RADIUS;
+				const float mi = scale[i] * scale[i];
+				grid.ForEachNeighbor(posX[i], posY[i], [&](int j) {
+					const float dx = posX[j] - posX[i];
+					const float dy = posY[j] - posY[i];
+					const float r = ri + scale[j] * COLLISION_RADIUS;
+					const float d2 = dx * dx + dy * dy;
+					if (j == i || d2 >= r * r || d2 < 1e-6f) {
+						return;
+					}
+					const float d = std::sqrt(d2);
+					const float nx = dx / d, ny = dy / d;
+					// closing speed along the line between the two
+					const float vn = (velX[j] - velX[i]) * nx + (velY[j] - velY[i]) * ny;
+					if (vn < 0) {
+						// an inelastic hit, the lighter flake changes more
+						const float mj = scale[j] * scale[j];
+						const float w = mj / (mi + mj);
+						vx += w * vn * nx;
+						vy += w * vn * ny;
+					}
+				});
+				newVelX[i] = vx;
+				newVelY[i] = vy;
+			}
+		});
+		velX.swap(newVelX);
+		velY.swap(newVelY);
 	}
 
-private:
-	Mass* newMass()
+	// moves flake order[k] to slot k, for all flakes
+	void reorder(const std::vector<int>& order)
 	{
-		auto x = float(rand() % width) - float(width) / 2;
-		auto y = float(height / 2) + (minScale + maxScale) / 2;
+		AlignedVector<float>* arrays[] = {&posX, &posY, &prevX, &prevY, &velX, &velY, &life, &alpha, &fadeSpeed, &scale};
+		for (auto array : arrays) {
+			jobs->ParallelFor(count, CHUNK_SIZE, [this, array, &order](int begin, int end) {
+				const float* src = array->data();
+				for (int k = begin; k < end; k++) {
+					scratch[k] = src[order[k]];
+				}
+			});
+			array->swap(scratch);
+		}
+		for (int k = 0; k < count; k++) {
+			idScratch[k] = id[order[k]];
+		}
+		id.swap(idScratch);
+	}
 
-		auto scale = fmod(float(rand()) / 100.0f, maxScale - minScale) + minScale;
+	void integrate(int begin, int end, float dt, ChunkResult& result)
+	{
+		if (field != nullptr) {
+			field->Apply(begin, end, time, dt, posX.data(), posY.data(), velX.data(), velY.data());
+		}
 
-		if (available.size() > 0) {
-			auto ret = available.front();
-			available.pop_front();
+		const float ax = gravity.x * dt;
+		const float ay = gravity.y * dt;
+		for (int i = begin; i < end; i++) {
+			prevX[i] = posX[i];
+			prevY[i] = posY[i];
+			velX[i] += ax;
+			velY[i] += ay;
+			posX[i] += velX[i] * dt;
+			posY[i] += velY[i] * dt;
+			alpha[i] = glm::max(alpha[i] - fadeSpeed[i] * dt, 0.0f);
+			life[i] -= dt;
+		}
 
-			// reset
-			ret->Init(massMass, glm::vec3{x, y, 0}, initSpeed, initLife, scale);
+		if (ground != nullptr) {
+			for (int i = begin; i < end; i++) {
+				life[i] = touchesGround(i) ? 0.0f : life[i];
+			}
+		}
 
-			return ret;
-		} else {
-			return new Mass(massMass, glm::vec3{x, y, 0}, initSpeed, initLife, scale);
+		result.dead.clear();
+		result.deposits.clear();
+		for (int i = begin; i < end; i++) {
+			if (life[i] < 1e-2) {
+				result.dead.push_back(i);
+				if (ground != nullptr && touchesGround(i)) {
+					result.deposits.push_back(ground->Land(posX[i], scale[i]));
+				}
+			}
 		}
 	}
 
-	void drawMass(const Mass* mass, const Shader& shader, GLuint VAO, GLuint texture, const glm::mat4& view, const glm::mat4& projection) const
+	// whether the bottom of the flake reached the snow cover, O(1) per flake
+	bool touchesGround(int i) const
 	{
-		shader.Use();
+		const float top = -float(height) / 2 + ground->Height(ground->Column(posX[i]));
+		return posY[i] - scale[i] / 2 <= top;
+	}
 
-		glUniform2fv(glGetUniformLocation(shader.Program(), "offset"), 1,glm::value_ptr(mass->position));
-		glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		glUniform1f(glGetUniformLocation(shader.Program(), "scale"), mass->scale);
-		glUniform1f(glGetUniformLocation(shader.Program(), "alpha"), mass->alpha);
+	// u holds the uniform random numbers drawn for this flake
+	void emit(const glm::vec4& u)
+	{
+		const int i = count++;
+
+		posX[i] = u.x * float(width) - float(width) / 2;
+		posY[i] = float(height / 2) + (minScale + maxScale) / 2;
+		prevX[i] = posX[i];
+		prevY[i] = posY[i];
+		velX[i] = initSpeed.x;
+		velY[i] = initSpeed.y;
+		life[i] = initLife;
+		alpha[i] = 1.0f;
+		fadeSpeed[i] = 1.0f / initLife;
+		scale[i] = minScale + u.y * (maxScale - minScale);
+		id[i] = freeIds.back();
+		freeIds.pop_back();
+	}
 
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		glBindVertexArray(0);
+	void retire(int i)
+	{
+		const int last = --count;
+
+		freeIds.push_back(id[i]);
+
+		posX[i] = posX[last];
+		posY[i] = posY[last];
+		prevX[i] = prevX[last];
+		prevY[i] = prevY[last];
+		velX[i] = velX[last];
+		velY[i] = velY[last];
+		life[i] = life[last];
+		alpha[i] = alpha[last];
+		fadeSpeed[i] = fadeSpeed[last];
+		scale[i] = scale[last];
+		id[i] = id[last];
 	}
 };
 
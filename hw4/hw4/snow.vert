@@ -7,18 +7,21 @@
 // input vertex attributes
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texCoord;
+// per-flake attributes: <vec2 offset, float scale, float alpha>
+layout (location = 2) in vec4 flake;
 
 out vec2 mapCoord;
-
-uniform vec2 offset;
+out vec2 worldPos;
+out float flakeAlpha;
 
 uniform mat4 projection;
 uniform mat4 view;
 
-uniform float scale;
-
 void main()
 {
-	gl_Position = projection * view * vec4((position.xy * scale) + offset, 0, 1.0);
+	// bigger flakes are nearer, in front of the background
+	worldPos = (position.xy * flake.z) + flake.xy;
+	gl_Position = projection * view * vec4(worldPos, flake.z, 1.0);
 	mapCoord = vec2(texCoord.x, texCoord.y);
+	flakeAlpha = flake.w;
 }
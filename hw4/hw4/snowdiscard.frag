@@ -0,0 +1,24 @@
+/*
+ * GLSL Fragment Shader code for OpenGL version 3.3
+ */
+
+#version 330 core
+
+// The old snow shader, kept for the fill-rate comparison of --bench only:
+// the raw sprite, near-white texels discarded.
+
+in vec2 mapCoord;
+in float flakeAlpha;
+
+out vec4 color;
+
+uniform sampler2D texMap;
+
+void main()
+{
+	color = texture(texMap, mapCoord);
+	if (color.r + color.g + color.b >= 2.7f) {
+		discard;
+	}
+	color.a = flakeAlpha;
+}
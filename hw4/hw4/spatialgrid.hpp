@@ -0,0 +1,183 @@
+#ifndef CG_SPATIALGRID_H_
+#define CG_SPATIALGRID_H_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "jobs.hpp"
+
+namespace cg
+{
+
+/* A uniform grid over the XY plane for neighbour queries, hashed into a fixed-size table so
+ * it needs no bounds. The cell size should be at least the query radius, then all neighbours
+ * of a point lie in the 3x3 cells around it.
+ *
+ * Build() sorts the particle indices by hash bucket with a parallel counting sort: every chunk
+ * counts its particles per bucket, the counts are turned into offsets, then every chunk writes
+ * its particles to their places. The sort is stable, so the order depends only on the positions,
+ * not on the number of threads. Particles may then be reordered into Order() for better cache
+ * locality, see Reindexed().
+*/
+class SpatialGrid
+{
+public:
+	// tableSize is rounded up to a power of two
+	SpatialGrid(float cellSize, int tableSize) :
+		invCellSize(1.0f / cellSize)
+	{
+		int size = 1;
+		while (size < tableSize) {
+			size *= 2;
+		}
+		mask = uint32_t(size - 1);
+		cellStart.resize(size + 1);
+	}
+
+	virtual ~SpatialGrid() { }
+
+	int TableSize() const { return int(mask) + 1; }
+
+	// Particle indices ordered by bucket.
+	const std::vector<int>& Order() const { return order; }
+
+	uint32_t Bucket(float x, float y) const
+	{
+		return bucket(cellOf(x), cellOf(y));
+	}
+
+	void Build(const float* x, const float* y, int n, JobSystem& jobs)
+	{
+		const int table = TableSize();
+		const int numChunks = std::max(1, std::min(jobs.Workers(), n / MIN_CHUNK));
+		const int chunkSize = (n + numChunks - 1) / numChunks;
+
+		keys.resize(n);
+		order.resize(n);
+		counts.resize(size_t(numChunks) * table);
+
+		// count the particles of each chunk per bucket
+		jobs.ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int c = begin; c < end; c++) {
+				int* count = &counts[size_t(c) * table];
+				std::fill(count, count + table, 0);
+				const int last = std::min(n, (c + 1) * chunkSize);
+				for (int i = c * chunkSize; i < last; i++) {
+					keys[i] = Bucket(x[i], y[i]);
+					count[keys[i]]++;
+				}
+			}
+		});
+
+		// offsets in bucket-major, chunk-minor order: first the bucket totals of each block of buckets,
+		// then the running offsets inside each block
+		int numBlocks = 1;
+		while (numBlocks * 2 <= jobs.Workers() * 4 && numBlocks * 2 * 1024 <= table) {
+			numBlocks *= 2;
+		}
+		const int blockSize = table / numBlocks;
+		blockStart.resize(numBlocks + 1);
+		jobs.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				int sum = 0;
+				for (int b = k * blockSize; b < (k + 1) * blockSize; b++) {
+					for (int c = 0; c < numChunks; c++) {
+						sum += counts[size_t(c) * table + b];
+					}
+				}
+				blockStart[k + 1] = sum;
+			}
+		});
+		blockStart[0] = 0;
+		for (int k = 0; k < numBlocks; k++) {
+			blockStart[k + 1] += blockStart[k];
+		}
+		jobs.ParallelFor(numBlocks, 1, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				int offset = blockStart[k];
+				for (int b = k * blockSize; b < (k + 1) * blockSize; b++) {
+					cellStart[b] = offset;
+					for (int c = 0; c < numChunks; c++) {
+						int& count = counts[size_t(c) * table + b];
+						const int num = count;
+						count = offset;
+						offset += num;
+					}
+				}
+			}
+		});
+		cellStart[table] = n;
+
+		// every chunk scatters its particles behind those of the chunks before it
+		jobs.ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int c = begin; c < end; c++) {
+				int* offset = &counts[size_t(c) * table];
+				const int last = std::min(n, (c + 1) * chunkSize);
+				for (int i = c * chunkSize; i < last; i++) {
+					order[offset[keys[i]]++] = i;
+				}
+			}
+		});
+	}
+
+	// Tells the grid that the particles were moved into Order(), so that particle Order()[k]
+	// is now particle k. Queries then return the new indices.
+	void Reindexed()
+	{
+		for (int k = 0; k < int(order.size()); k++) {
+			order[k] = k;
+		}
+	}
+
+	// Calls f(j) for each particle j in the 3x3 cells around (x, y). The cells are hashed, so
+	// particles of other, far away cells may be included too; check the distance in f.
+	template <typename F>
+	void ForEachNeighbor(float x, float y, F f) const
+	{
+		const int cx = cellOf(x), cy = cellOf(y);
+		uint32_t visited[9];
+		int numVisited = 0;
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				const uint32_t b = bucket(cx + dx, cy + dy);
+				// neighbouring cells may share a bucket, visit it once
+				if (std::find(visited, visited + numVisited, b) != visited + numVisited) {
+					continue;
+				}
+				visited[numVisited++] = b;
+				for (int k = cellStart[b]; k < cellStart[b + 1]; k++) {
+					f(order[k]);
+				}
+			}
+		}
+	}
+
+private:
+	// particles per chunk of the sort at least
+	static constexpr int MIN_CHUNK = 4096;
+
+	float invCellSize;
+	uint32_t mask;
+
+	std::vector<int> cellStart;     // first position of each bucket in order
+	std::vector<int> order;
+	std::vector<uint32_t> keys;     // bucket of each particle
+	std::vector<int> counts;        // per chunk and bucket: count, then write offset
+	std::vector<int> blockStart;
+
+	int cellOf(float v) const
+	{
+		return int(std::floor(v * invCellSize));
+	}
+
+	uint32_t bucket(int cx, int cy) const
+	{
+		return (uint32_t(cx) * 73856093u ^ uint32_t(cy) * 19349663u) & mask;
+	}
+};
+
+} /* namespace cg */
+
+#endif /* CG_SPATIALGRID_H_ */
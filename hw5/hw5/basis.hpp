@@ -0,0 +1,81 @@
+#ifndef CG_BASIS_H_
+#define CG_BASIS_H_
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bezier.hpp"
+
+namespace cg
+{
+/* The Bernstein polynomials B_i,4 and their derivatives at the parameters k / level, k = 0..level,
+ * in a uniform buffer for bezier.tese.
+ *
+ * With fixed levels, equal_spacing rounds the level up to an integer and every gl_TessCoord of
+ * the patch is a multiple of 1 / level, so the evaluation shader can look the weights up instead
+ * of computing them. Parameter k takes 3 vec4s (std140 pads arrays of floats to vec4 anyway):
+ * <B_0..B_3>, <B'_0..B'_3>, <B_4, B'_4, 0, 0>.
+*/
+class BasisTable
+{
+public:
+    static constexpr int MAX_LEVEL = 64;    // the TCS clamps the adaptive levels to this, too
+    static constexpr GLuint BINDING = 0;    // uniform block binding of Basis in bezier.tese
+
+    BasisTable() : level(0), UBO(0) { }
+
+    virtual ~BasisTable() { }
+
+    /* Getters */
+    int Level() const { return level; }
+
+    void SetupBuffers()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(entries), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void ReleaseBuffers()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+        level = 0;
+    }
+
+    // Tabulates the basis for an integer level, only if it changed.
+    void Update(int newLevel)
+    {
+        newLevel = glm::clamp(newLevel, 1, MAX_LEVEL);
+        if (newLevel == level) {
+            return;
+        }
+        level = newLevel;
+
+        for (int k = 0; k <= level; k++) {
+            float b[BezierPatch::ORDER], d[BezierPatch::ORDER];
+            BezierPatch::Bernstein(float(k) / float(level), b, d);
+            entries[3 * k] = glm::vec4{b[0], b[1], b[2], b[3]};
+            entries[3 * k + 1] = glm::vec4{d[0], d[1], d[2], d[3]};
+            entries[3 * k + 2] = glm::vec4{b[4], d[4], 0.0f, 0.0f};
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, GLsizeiptr(3 * (level + 1) * sizeof(glm::vec4)), entries);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void Bind() const
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+    }
+
+private:
+    int level;
+    GLuint UBO;
+    glm::vec4 entries[3 * (MAX_LEVEL + 1)];
+};
+
+} /* namespace cg */
+
+#endif /* CG_BASIS_H_ */
@@ -4,17 +4,77 @@
 
 #version 460 core
 
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+struct Light {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
 in vec2 texCoord;
+in vec3 fragPos;
+in vec3 normal;
+in vec2 patchCoord;
+flat in int trimLayer;
 out vec4 color;
 
-uniform sampler2D texMap;
+layout (binding = 0) uniform sampler2D texMap;
 uniform bool useTexture;
 
+// trim masks of NURBS patches (nurbs.hpp), 0 where the surface is cut away
+layout (binding = 1) uniform sampler2DArray trimMask;
+
+uniform bool useLighting;
+uniform bool analyticNormals;
+uniform vec3 viewPos;
+uniform Material material;
+uniform Light light;
+
 void main()
 {
+    if (trimLayer >= 0 && texture(trimMask, vec3(patchCoord, float(trimLayer))).r < 0.5) {
+        discard;
+    }
+
+    vec4 base;
     if (useTexture) {
-	    color = texture(texMap, texCoord);
+	    base = texture(texMap, texCoord);
+    } else {
+	    base = vec4(0.4f, 0.9f, 0.3f, 1.0f);
+    }
+    if (!useLighting) {
+        color = base;
+        return;
+    }
+
+    // the surface is open, light whichever side faces the viewer
+    vec3 norm;
+    if (analyticNormals) {
+        norm = normalize(gl_FrontFacing ? normal : -normal);
     } else {
-	    color = vec4(0.4f, 0.9f, 0.3f, 1.0f);
+        norm = normalize(cross(dFdx(fragPos), dFdy(fragPos)));
     }
+
+    // ambient
+    vec3 ambient = light.ambient * material.ambient * base.rgb;
+
+    // diffuse
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * (diff * material.diffuse * base.rgb);
+
+    // specular
+    vec3 viewDir = normalize(viewPos - fragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    vec3 specular = light.specular * (spec * material.specular);
+
+    color = vec4(ambient + diffuse + specular, base.a);
 }
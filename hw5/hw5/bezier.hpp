@@ -0,0 +1,284 @@
+#ifndef CG_BEZIER_H_
+#define CG_BEZIER_H_
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace cg
+{
+/* A tensor-product Bezier patch of degree 4 (5x5 control points), tessellated on the CPU into
+ * an indexed triangle grid, e.g. where tessellation shaders are not available.
+ *
+ * Control point (row j, column i) is the j * 5 + i'th point, u runs along a row and v across
+ * the rows, the same as in bezier.tese. The Bernstein polynomials and their derivatives are
+ * tabulated once per resolution. For each row of the grid, the 5 rows of the net are first
+ * collapsed into one curve in u (and its derivative in v), which is then evaluated at all u of
+ * the row, 8 at a time with AVX2 if the compiler targets it.
+*/
+class BezierPatch
+{
+public:
+    static constexpr int ORDER = 5;     // control points per side
+    static constexpr int DEGREE = ORDER - 1;
+
+    struct Vertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 texCoord;
+    };
+
+    // coords: x, y, z of the ORDER * ORDER control points, row by row
+    explicit BezierPatch(const GLfloat* coords) :
+        resolution(0), VAO(0), VBO(0), EBO(0)
+    {
+        for (int k = 0; k < ORDER * ORDER; k++) {
+            points[k] = glm::vec3{coords[3 * k], coords[3 * k + 1], coords[3 * k + 2]};
+        }
+    }
+
+    virtual ~BezierPatch() { }
+
+    // Replaces the ORDER * ORDER control points, row by row; Tessellate() again to see them.
+    void SetControlPoints(const glm::vec3* net)
+    {
+        for (int k = 0; k < ORDER * ORDER; k++) {
+            points[k] = net[k];
+        }
+    }
+
+    /* Getters */
+    int Resolution() const { return resolution; }
+    const std::vector<Vertex>& Vertices() const { return vertices; }
+    const std::vector<GLuint>& Indices() const { return indices; }
+
+    // B_i,4(t) and its derivative 4 * (B_i-1,3(t) - B_i,3(t)), ORDER values each
+    static void Bernstein(float t, float* b, float* d)
+    {
+        const float s = 1.0f - t;
+        const float cubic[DEGREE] = {s * s * s, 3 * t * s * s, 3 * t * t * s, t * t * t};
+        b[0] = s * s * s * s;
+        b[1] = 4 * t * s * s * s;
+        b[2] = 6 * t * t * s * s;
+        b[3] = 4 * t * t * t * s;
+        b[4] = t * t * t * t;
+        for (int i = 0; i < ORDER; i++) {
+            d[i] = DEGREE * ((i > 0 ? cubic[i - 1] : 0.0f) - (i < DEGREE ? cubic[i] : 0.0f));
+        }
+    }
+
+    // Point and unit normal at (u, v), the normal is dS/du x dS/dv.
+    void Evaluate(float u, float v, glm::vec3& position, glm::vec3& normal) const
+    {
+        float bu[ORDER], du[ORDER], bv[ORDER], dv[ORDER];
+        Bernstein(u, bu, du);
+        Bernstein(v, bv, dv);
+
+        glm::vec3 p{0}, tu{0}, tv{0};
+        for (int j = 0; j < ORDER; j++) {
+            for (int i = 0; i < ORDER; i++) {
+                const glm::vec3& c = points[j * ORDER + i];
+                p += bu[i] * bv[j] * c;
+                tu += du[i] * bv[j] * c;
+                tv += bu[i] * dv[j] * c;
+            }
+        }
+        position = p;
+        normal = safeNormalize(glm::cross(tu, tv));
+    }
+
+    // Evaluates the patch on a grid of resolution x resolution quads, two triangles each.
+    void Tessellate(int newResolution)
+    {
+        newResolution = newResolution < 1 ? 1 : newResolution;
+        const int n = newResolution + 1;
+        if (newResolution != resolution) {
+            resolution = newResolution;
+            buildTables();
+            buildIndices();
+        }
+        vertices.resize(size_t(n) * n);
+
+        glm::vec3 q[ORDER], dq[ORDER];
+        for (int row = 0; row < n; row++) {
+            // the curve in u at this v, and its derivative in v
+            for (int i = 0; i < ORDER; i++) {
+                q[i] = glm::vec3{0};
+                dq[i] = glm::vec3{0};
+                for (int j = 0; j < ORDER; j++) {
+                    q[i] += basis[j * n + row] * points[j * ORDER + i];
+                    dq[i] += derivative[j * n + row] * points[j * ORDER + i];
+                }
+            }
+            evaluateRow(q, dq, float(row) / float(resolution), &vertices[size_t(row) * n]);
+        }
+    }
+
+    /* GL objects, vertex attributes: 0 position, 1 normal, 2 texCoord */
+    void SetupBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoord));
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void ReleaseBuffers()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+    // Copies the last tessellation to the GL buffers.
+    void Upload() const
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void Draw() const
+    {
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, GLsizei(indices.size()), GL_UNSIGNED_INT, nullptr);
+        glBindVertexArray(0);
+    }
+
+private:
+    glm::vec3 points[ORDER * ORDER];
+    int resolution;     // quads per side
+
+    // Bernstein polynomials and their derivatives at the resolution + 1 parameters, [i * (resolution + 1) + k]
+    std::vector<float> basis, derivative;
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    GLuint VAO, VBO, EBO;
+
+    static glm::vec3 safeNormalize(const glm::vec3& v)
+    {
+        const float length = glm::length(v);
+        return length > 1e-12f ? v / length : glm::vec3{0.0f, 1.0f, 0.0f};
+    }
+
+    void buildTables()
+    {
+        const int n = resolution + 1;
+        basis.resize(size_t(ORDER) * n);
+        derivative.resize(size_t(ORDER) * n);
+        for (int k = 0; k < n; k++) {
+            float b[ORDER], d[ORDER];
+            Bernstein(float(k) / float(resolution), b, d);
+            for (int i = 0; i < ORDER; i++) {
+                basis[i * n + k] = b[i];
+                derivative[i * n + k] = d[i];
+            }
+        }
+    }
+
+    void buildIndices()
+    {
+        const int n = resolution + 1;
+        indices.clear();
+        indices.reserve(size_t(resolution) * resolution * 6);
+        for (int row = 0; row < resolution; row++) {
+            for (int col = 0; col < resolution; col++) {
+                const GLuint a = GLuint(row * n + col), b = a + 1, c = a + GLuint(n), d = c + 1;
+                // counter-clockwise in (u, v)
+                indices.insert(indices.end(), {a, b, d, a, d, c});
+            }
+        }
+    }
+
+    // q: control points of the curve in u, dq: their derivatives in v
+    void evaluateRow(const glm::vec3* q, const glm::vec3* dq, float v, Vertex* out) const
+    {
+        const int n = resolution + 1;
+        int k = 0;
+#ifdef __AVX2__
+        for (; k + 8 <= n; k += 8) {
+            __m256 px = _mm256_setzero_ps(), py = px, pz = px;
+            __m256 ux = px, uy = px, uz = px;
+            __m256 vx = px, vy = px, vz = px;
+            for (int i = 0; i < ORDER; i++) {
+                const __m256 b = _mm256_loadu_ps(&basis[i * n + k]);
+                const __m256 d = _mm256_loadu_ps(&derivative[i * n + k]);
+                const __m256 qx = _mm256_set1_ps(q[i].x), qy = _mm256_set1_ps(q[i].y), qz = _mm256_set1_ps(q[i].z);
+                px = _mm256_fmadd_ps(b, qx, px);
+                py = _mm256_fmadd_ps(b, qy, py);
+                pz = _mm256_fmadd_ps(b, qz, pz);
+                ux = _mm256_fmadd_ps(d, qx, ux);
+                uy = _mm256_fmadd_ps(d, qy, uy);
+                uz = _mm256_fmadd_ps(d, qz, uz);
+                vx = _mm256_fmadd_ps(b, _mm256_set1_ps(dq[i].x), vx);
+                vy = _mm256_fmadd_ps(b, _mm256_set1_ps(dq[i].y), vy);
+                vz = _mm256_fmadd_ps(b, _mm256_set1_ps(dq[i].z), vz);
+            }
+            // normal = du x dv
+            const __m256 nx = _mm256_fmsub_ps(uy, vz, _mm256_mul_ps(uz, vy));
+            const __m256 ny = _mm256_fmsub_ps(uz, vx, _mm256_mul_ps(ux, vz));
+            const __m256 nz = _mm256_fmsub_ps(ux, vy, _mm256_mul_ps(uy, vx));
+            const __m256 length2 = _mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz)));
+
+            alignas(32) float result[6][8];
+            _mm256_store_ps(result[0], px);
+            _mm256_store_ps(result[1], py);
+            _mm256_store_ps(result[2], pz);
+            _mm256_store_ps(result[3], nx);
+            _mm256_store_ps(result[4], ny);
+            _mm256_store_ps(result[5], nz);
+            alignas(32) float length[8];
+            _mm256_store_ps(length, _mm256_sqrt_ps(length2));
+            for (int l = 0; l < 8; l++) {
+                Vertex& vertex = out[k + l];
+                vertex.position = glm::vec3{result[0][l], result[1][l], result[2][l]};
+                vertex.normal = length[l] > 1e-12f
+                    ? glm::vec3{result[3][l], result[4][l], result[5][l]} / length[l]
+                    : glm::vec3{0.0f, 1.0f, 0.0f};
+                vertex.texCoord = glm::vec2{float(k + l) / float(resolution), v};
+            }
+        }
+#endif
+        for (; k < n; k++) {
+            glm::vec3 p{0}, tu{0}, tv{0};
+            for (int i = 0; i < ORDER; i++) {
+                const float b = basis[i * n + k];
+                p += b * q[i];
+                tu += derivative[i * n + k] * q[i];
+                tv += b * dq[i];
+            }
+            out[k].position = p;
+            out[k].normal = safeNormalize(glm::cross(tu, tv));
+            out[k].texCoord = glm::vec2{float(k) / float(resolution), v};
+        }
+    }
+};
+
+} /* namespace cg */
+
+#endif /* CG_BEZIER_H_ */
@@ -4,14 +4,17 @@
 
 #version 460 core
 
-// input vertex attributes
-layout (location = 0) in vec3 position;
+// control points shared by all patches, the index buffer picks them by gl_VertexID
+layout (std430, binding = 0) readonly buffer ControlPoints
+{
+	vec4 points[];
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(position, 1.0);
+	// control points stay in world space, the evaluation shader projects the surface; they may be
+	// homogeneous (NURBS), an affine model matrix commutes with the weight
+	gl_Position = model * points[gl_VertexID];
 }
@@ -0,0 +1,133 @@
+#ifndef CG_CACHE_H_
+#define CG_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "bezier.hpp"
+#include "surface.hpp"
+
+namespace cg
+{
+/* The triangles of a surface tessellated at a fixed level, captured once with transform feedback
+ * and drawn again with a plain vertex shader until the surface or the level changes.
+ *
+ * The capture program must write fragPos, normal and texCoord, interleaved in this order, which
+ * is the layout of BezierPatch::Vertex, so the captured buffer is drawn with the same attributes
+ * as the CPU tessellation (0 position, 1 normal, 2 texCoord). The positions are in world space.
+ * The surface is recognised by its address and Revision(), which changes with every edit.
+*/
+class TessellationCache
+{
+public:
+    // surfaces whose triangles would need more memory are not cached
+    static constexpr uint64_t MAX_BYTES = uint64_t(256) << 20;
+
+    TessellationCache() :
+        surface(nullptr), revision(0), level(0), capacity(0), VAO(0), VBO(0), TFO(0)
+    {
+    }
+
+    virtual ~TessellationCache() { }
+
+    // Bytes of the triangles of the surface at this integer level: with all outer and inner levels
+    // equal to n, equal_spacing splits each quad patch into exactly 2 * n * n triangles.
+    static uint64_t Bytes(const Surface& s, int level)
+    {
+        return uint64_t(s.Patches()) * 2 * level * level * 3 * sizeof(BezierPatch::Vertex);
+    }
+
+    // Whether the captured triangles are those of this surface at this level.
+    bool Covers(const Surface& s, int level) const
+    {
+        return surface == &s && revision == s.Revision() && this->level == level;
+    }
+
+    /* GL objects */
+    void SetupBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenTransformFeedbacks(1, &TFO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BezierPatch::Vertex), (GLvoid*)offsetof(BezierPatch::Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BezierPatch::Vertex), (GLvoid*)offsetof(BezierPatch::Vertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(BezierPatch::Vertex), (GLvoid*)offsetof(BezierPatch::Vertex, texCoord));
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void ReleaseBuffers()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteTransformFeedbacks(1, &TFO);
+        VAO = VBO = TFO = 0;
+        Invalidate();
+        capacity = 0;
+    }
+
+    void Invalidate()
+    {
+        surface = nullptr;
+    }
+
+    // Tessellates the surface with the bound capture program, whose uniforms must already be set
+    // for a fixed level. Returns false, and keeps nothing, if the triangles are over MAX_BYTES.
+    bool Capture(const Surface& s, int level)
+    {
+        const uint64_t bytes = Bytes(s, level);
+        if (bytes > MAX_BYTES) {
+            Invalidate();
+            return false;
+        }
+        // only ever grows, so editing does not reallocate
+        if (bytes > capacity) {
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(bytes), nullptr, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            capacity = bytes;
+        }
+
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, TFO);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, VBO);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBeginTransformFeedback(GL_TRIANGLES);
+        s.Draw();
+        glEndTransformFeedback();
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+        surface = &s;
+        revision = s.Revision();
+        this->level = level;
+        return true;
+    }
+
+    // Draws the captured triangles with the bound program, the vertex count stays on the GPU.
+    void Draw() const
+    {
+        glBindVertexArray(VAO);
+        glDrawTransformFeedback(GL_TRIANGLES, TFO);
+        glBindVertexArray(0);
+    }
+
+private:
+    const Surface* surface;     // captured surface, nullptr if nothing is cached
+    unsigned revision;
+    int level;
+    uint64_t capacity;          // bytes allocated for VBO
+
+    GLuint VAO, VBO, TFO;
+};
+
+} /* namespace cg */
+
+#endif /* CG_CACHE_H_ */
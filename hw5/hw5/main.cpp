@@ -3,6 +3,12 @@
  * Draw a Bezier surface with tesselation.
  */
 #include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <random>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +25,12 @@
 #include "camera.hpp"
 #include "shader.hpp"
 #include "text.hpp"
+#include "bezier.hpp"
+#include "surface.hpp"
+#include "surfacemesh.hpp"
+#include "nurbs.hpp"
+#include "basis.hpp"
+#include "cache.hpp"
 
 using namespace cg;
 
@@ -33,9 +45,23 @@ int screenWidth = 1280;
 int screenHeight = 960;
 
 float level = 5.0f;
+// levels from the size of the surface on screen, aiming at triangles of triangleSize pixels
+bool adaptiveLevels = false;
+float triangleSize = 16.0f;
 bool showText = true;
 bool showPoints = true;
 DisplayMode currentMode = DisplayMode::FACE;
+// tessellate on the CPU instead of with tessellation shaders
+bool cpuTessellation = false;
+bool hasTessellation = true;
+// look the Bernstein weights up in a table instead of computing them, fixed levels only
+bool basisLookup = false;
+// with a fixed level, tessellate a surface once and draw the captured triangles until it changes
+bool cacheTessellation = false;
+// Phong lighting, with normals from the derivatives of the surface or from screen-space derivatives
+bool useLighting = true;
+bool analyticNormals = true;
+const glm::vec3 lightPos(0.0f, 10.0f, 2.0f);
 
 Camera camera(glm::vec3(0.0f, 2.5f, 3.0f));
 bool keys[1024]{false};
@@ -73,16 +99,64 @@ constexpr GLfloat vertices[] = {
         1.5, -1., 0.
 };
 
+// the shown surface tessellated on the CPU
+SurfaceMesh cpuMesh;
+BasisTable basisTable;
+TessellationCache cache;
+
+// surfaces to switch between: the patch above, a terrain, and the patches in SURFACE_FILE if there is one
+std::vector<Surface> surfaces;
+std::vector<std::string> surfaceNames;
+int currentSurface = 0;
+// the surface drawn in the last frame, currentSurface unless it is too large for the CPU path
+int shownSurface = 0;
+constexpr int TERRAIN = 1;
+constexpr const char* const SURFACE_FILE = "teapot.txt";
+// control points per side of the terrain, 250 x 250 patches
+constexpr int TERRAIN_POINTS = 1001;
+bool terrainC1 = false;
+bool rebuildTerrain = false;
+
+// a trimmed rational torus drawn instead of the surfaces, GPU path only
+NurbsSurface nurbs;
+bool showNurbs = false;
+bool nurbsShown = false;
+
+// the control point being dragged, -1 if none: it keeps its offset from the view ray, at
+// dragDistance along the ray from the camera
+int dragSurface = 0;
+int dragPoint = -1;
+float dragDistance = 0.0f;
+glm::vec3 dragOffset(0.0f);
+// points within this angle of the view ray can be picked
+const float PICK_ANGLE = glm::radians(1.0f);
+
 // callbacks
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void moveCamera(GLfloat deltaTime);
 void changeScale(GLfloat deltaTime);
-
-int main()
+void buildTerrain(Surface& terrain);
+void buildNurbs(NurbsSurface& surface);
+
+// benchmarks
+void benchPatch(const Shader* captureShader);
+void benchLevels(const Shader& surfaceShader);
+void benchPatches(const Shader& surfaceShader);
+void benchDerivatives(const Shader& surfaceShader);
+void benchBasis(const Shader& surfaceShader);
+void benchCache(const Shader& surfaceShader, const Shader& captureShader, const Shader& meshShader);
+void benchEdits();
+void benchNurbs(const Shader* nurbsShader);
+
+int main(int argc, char* argv[])
 {
+	// with --bench, run the benchmarks in a hidden window and exit
+	const bool benchmark = argc > 1 && std::string(argv[1]) == "--bench";
+
 	// Setup a GLFW window
 
 	// init GLFW, set GL version & pipeline info
@@ -90,6 +164,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, benchmark ? GLFW_FALSE : GLFW_TRUE);
 
 	// create a window
 	GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Yifei Li - Assignment 5", nullptr, nullptr);
@@ -107,6 +182,7 @@ int main()
     glfwSetKeyCallback(window, keyCallback);
     glfwSetCursorPosCallback(window, mouseCallback);
     glfwSetScrollCallback(window, scrollCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
 
 	// ---------------------------------------------------------------
 
@@ -125,14 +201,34 @@ int main()
     // ---------------------------------------------------------------
 
 	// Install GLSL Shader programs
+	// a 4.6 context always has tessellation, so this only catches shaders the driver fails to build;
+	// a GPU without tessellation cannot create the window at all
 	auto surfaceShader = Shader::Create("bezier.vert", "bezier.frag", "bezier.tesc", "bezier.tese");
 	if (surfaceShader == nullptr) {
-		std::cerr << "Error creating Shader Program" << std::endl;
-		glfwTerminate();
-		return -3;
+		std::cerr << "The tessellation shaders could not be built, tessellating on the CPU" << std::endl;
+		cpuTessellation = true;
+		hasTessellation = false;
 	}
 
-    auto pointShader = Shader::Create("bezier.vert", "point.frag");
+    // the same program, capturing what the evaluation shader outputs
+    auto captureShader = Shader::Create("bezier.vert", "bezier.frag", "bezier.tesc", "bezier.tese", {"fragPos", "normal", "texCoord"});
+    if (surfaceShader != nullptr && captureShader == nullptr) {
+        std::cerr << "Transform feedback is not available, the tessellation is not cached" << std::endl;
+    }
+
+    auto nurbsShader = Shader::Create("nurbs.vert", "bezier.frag", "nurbs.tesc", "nurbs.tese");
+    if (surfaceShader != nullptr && nurbsShader == nullptr) {
+        std::cerr << "NURBS shaders are not available, the torus is not shown" << std::endl;
+    }
+
+    auto meshShader = Shader::Create("mesh.vert", "bezier.frag");
+    if (meshShader == nullptr) {
+        std::cerr << "Error creating Shader Program" << std::endl;
+        glfwTerminate();
+        return -3;
+    }
+
+    auto pointShader = Shader::Create("point.vert", "point.frag");
     if (pointShader == nullptr) {
         std::cerr << "Error creating Shader Program" << std::endl;
         glfwTerminate();
@@ -175,25 +271,63 @@ int main()
 
 	// Set up vertex data (and buffer(s)) and attribute pointers
 
-	// bind VAO
-	GLuint VAO;
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
-
-	// bind VBO, buffer data to it
-	GLuint VBO;
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// set vertex attribute pointers
-	// position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
+    // number of triangles drawn, read a frame later to avoid waiting for the GPU
+    GLuint trianglesQuery;
+    glGenQueries(1, &trianglesQuery);
+    bool queryPending = false;
+    GLuint triangles = 0;
+
+    // control points of all surfaces are read from storage buffers by the vertex shaders
+    surfaces.resize(2);
+    surfaces[0].SetPatch(vertices);
+    surfaceNames.push_back("single patch");
+    buildTerrain(surfaces[TERRAIN]);
+    surfaceNames.push_back("terrain");
+    Surface loaded;
+    if (loaded.Load(SURFACE_FILE)) {
+        surfaces.push_back(loaded);
+        surfaceNames.push_back(SURFACE_FILE);
+    }
+    for (auto& surface : surfaces) {
+        surface.SetupBuffers();
+        surface.Upload();
+    }
 
-	// unbind VBO & VAO
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+    // the same surfaces tessellated on the CPU
+    cpuMesh.SetupBuffers();
+
+    buildNurbs(nurbs);
+    nurbs.SetupBuffers();
+    nurbs.Upload();
+    basisTable.SetupBuffers();
+    cache.SetupBuffers();
+
+    if (benchmark) {
+        glViewport(0, 0, screenWidth, screenHeight);
+        benchPatch(captureShader.get());
+        benchEdits();
+        benchNurbs(nurbsShader.get());
+        if (surfaceShader != nullptr) {
+            benchLevels(*surfaceShader);
+            benchPatches(*surfaceShader);
+            benchDerivatives(*surfaceShader);
+            benchBasis(*surfaceShader);
+            if (captureShader != nullptr) {
+                benchCache(*surfaceShader, *captureShader, *meshShader);
+            }
+        }
+        for (auto& surface : surfaces) {
+            surface.ReleaseBuffers();
+        }
+        glDeleteTextures(1, &texture);
+        glDeleteQueries(1, &trianglesQuery);
+        cpuMesh.ReleaseBuffers();
+        nurbs.ReleaseBuffers();
+        basisTable.ReleaseBuffers();
+        cache.ReleaseBuffers();
+        glfwTerminate();
+        return 0;
+    }
 
 	// ---------------------------------------------------------------
 
@@ -215,6 +349,34 @@ int main()
 		/* your update code here */
         moveCamera(deltaTime);
         changeScale(deltaTime);
+        if (rebuildTerrain) {
+            buildTerrain(surfaces[TERRAIN]);
+            rebuildTerrain = false;
+        }
+        if (dragPoint >= 0) {
+            Surface& edited = surfaces[dragSurface];
+            const glm::vec3 position = camera.Position() + camera.Front() * dragDistance + dragOffset;
+            if (position != edited.ControlPoints()[dragPoint]) {
+                edited.SetPoint(dragPoint, position);
+                cpuMesh.UpdatePoint(edited, dragPoint);
+            }
+        }
+        // upload the surfaces that changed, which also makes their cached tessellation stale
+        for (auto& changed : surfaces) {
+            if (changed.Dirty()) {
+                changed.Upload();
+            }
+        }
+
+        // equal_spacing rounds a fixed level up, the CPU path, the cache and the basis table use that integer level
+        const int fixedLevel = int(std::ceil(level));
+        // surfaces too large to tessellate on the CPU fall back to the single patch there
+        shownSurface = currentSurface;
+        if (cpuTessellation && SurfaceMesh::Bytes(surfaces[shownSurface], fixedLevel) > SurfaceMesh::MAX_BYTES) {
+            shownSurface = 0;
+        }
+        const Surface& surface = surfaces[shownSurface];
+        nurbsShown = showNurbs && nurbsShader != nullptr && !cpuTessellation;
 	
 		// draw background
 		GLfloat red = 0.2f;
@@ -229,45 +391,122 @@ int main()
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom()), (float)screenWidth / (float)screenHeight, 0.1f, 100.0f);
 
         // Draw Bezier surface
-        surfaceShader->Use();
-        glUniform1f(glGetUniformLocation(surfaceShader->Program(), "uOuter02"), level);
-        glUniform1f(glGetUniformLocation(surfaceShader->Program(), "uOuter13"), level);
-        glUniform1f(glGetUniformLocation(surfaceShader->Program(), "uInner0"), level);
-        glUniform1f(glGetUniformLocation(surfaceShader->Program(), "uInner1"), level);
-        glUniformMatrix4fv(glGetUniformLocation(surfaceShader->Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(surfaceShader->Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(surfaceShader->Program(), "model"), 1, GL_FALSE, glm::value_ptr(model));
+        bool cached = false;
+        if (cacheTessellation && captureShader != nullptr && !cpuTessellation && !adaptiveLevels && !nurbsShown) {
+            if (!cache.Covers(surface, fixedLevel)) {
+                captureShader->Use();
+                glUniform1f(glGetUniformLocation(captureShader->Program(), "uOuter02"), level);
+                glUniform1f(glGetUniformLocation(captureShader->Program(), "uOuter13"), level);
+                glUniform1f(glGetUniformLocation(captureShader->Program(), "uInner0"), level);
+                glUniform1f(glGetUniformLocation(captureShader->Program(), "uInner1"), level);
+                glUniformMatrix4fv(glGetUniformLocation(captureShader->Program(), "model"), 1, GL_FALSE, glm::value_ptr(model));
+                glUniform1i(glGetUniformLocation(captureShader->Program(), "adaptive"), 0);
+                glUniform1i(glGetUniformLocation(captureShader->Program(), "analyticNormals"), 1);
+                glUniform1i(glGetUniformLocation(captureShader->Program(), "useBasisTable"), 0);
+                cache.Capture(surface, fixedLevel);
+            }
+            cached = cache.Covers(surface, fixedLevel);
+        }
+
+        const Shader& shader = nurbsShown ? *nurbsShader : cpuTessellation || cached ? *meshShader : *surfaceShader;
+        shader.Use();
+        glUniform1i(glGetUniformLocation(shader.Program(), "degreeU"), nurbs.DegreeU());
+        glUniform1i(glGetUniformLocation(shader.Program(), "degreeV"), nurbs.DegreeV());
+        glUniform1i(glGetUniformLocation(shader.Program(), "pointsInBuffer"), nurbs.PointsInBuffer());
+        glUniform1f(glGetUniformLocation(shader.Program(), "uOuter02"), level);
+        glUniform1f(glGetUniformLocation(shader.Program(), "uOuter13"), level);
+        glUniform1f(glGetUniformLocation(shader.Program(), "uInner0"), level);
+        glUniform1f(glGetUniformLocation(shader.Program(), "uInner1"), level);
+        glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        // the captured positions have the model transform applied already
+        const glm::mat4 surfaceModel = cached ? glm::mat4(1) : model;
+        glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "model"), 1, GL_FALSE, glm::value_ptr(surfaceModel));
+        glUniform1i(glGetUniformLocation(shader.Program(), "adaptive"), adaptiveLevels);
+        glUniform1f(glGetUniformLocation(shader.Program(), "triangleSize"), triangleSize);
+        glUniform2f(glGetUniformLocation(shader.Program(), "viewport"), GLfloat(screenWidth), GLfloat(screenHeight));
+
+        // light and material, the texture (or the wireframe color) scales the ambient and diffuse terms
+        glUniform1i(glGetUniformLocation(shader.Program(), "useLighting"), useLighting);
+        glUniform1i(glGetUniformLocation(shader.Program(), "analyticNormals"), analyticNormals);
+        glUniform3fv(glGetUniformLocation(shader.Program(), "viewPos"), 1, glm::value_ptr(camera.Position()));
+        glUniform3fv(glGetUniformLocation(shader.Program(), "light.position"), 1, glm::value_ptr(lightPos));
+        glUniform3f(glGetUniformLocation(shader.Program(), "light.ambient"), 0.25f, 0.25f, 0.25f);
+        glUniform3f(glGetUniformLocation(shader.Program(), "light.diffuse"), 0.8f, 0.8f, 0.8f);
+        glUniform3f(glGetUniformLocation(shader.Program(), "light.specular"), 1.0f, 1.0f, 1.0f);
+        glUniform3f(glGetUniformLocation(shader.Program(), "material.ambient"), 1.0f, 1.0f, 1.0f);
+        glUniform3f(glGetUniformLocation(shader.Program(), "material.diffuse"), 1.0f, 1.0f, 1.0f);
+        glUniform3f(glGetUniformLocation(shader.Program(), "material.specular"), 0.3f, 0.3f, 0.3f);
+        glUniform1f(glGetUniformLocation(shader.Program(), "material.shininess"), 32.0f);
+
+        const bool useBasisTable = basisLookup && !adaptiveLevels && !cpuTessellation && !cached && !nurbsShown;
+        if (useBasisTable) {
+            basisTable.Update(fixedLevel);
+            basisTable.Bind();
+        }
+        glUniform1i(glGetUniformLocation(shader.Program(), "useBasisTable"), useBasisTable);
+        glUniform1i(glGetUniformLocation(shader.Program(), "basisLevel"), basisTable.Level());
 
         switch (currentMode) {
         case DisplayMode::WIREFRAME:
             glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            glUniform1i(glGetUniformLocation(surfaceShader->Program(), "useTexture"), 0);
+            glUniform1i(glGetUniformLocation(shader.Program(), "useTexture"), 0);
             break;
         case DisplayMode::FACE:
             glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-            glUniform1i(glGetUniformLocation(surfaceShader->Program(), "useTexture"), 1);
+            glUniform1i(glGetUniformLocation(shader.Program(), "useTexture"), 1);
             break;
         default:
             break;
         }
 
+        if (queryPending) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(trianglesQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available != 0) {
+                glGetQueryObjectuiv(trianglesQuery, GL_QUERY_RESULT, &triangles);
+                queryPending = false;
+            }
+        }
+        const bool countTriangles = !queryPending;
+        if (countTriangles) {
+            glBeginQuery(GL_PRIMITIVES_GENERATED, trianglesQuery);
+        }
+
         glBindTexture(GL_TEXTURE_2D, texture);
-        glBindVertexArray(VAO);
-        glPatchParameteri(GL_PATCH_VERTICES, 25);
-        glDrawArrays(GL_PATCHES, 0, 25);
-        glBindVertexArray(0);
+        if (cpuTessellation) {
+            // equal_spacing rounds the level up, so both paths give the same grid
+            if (!cpuMesh.Covers(surface, fixedLevel)) {
+                cpuMesh.Build(surface, fixedLevel);
+            }
+            cpuMesh.Draw();
+        } else if (nurbsShown) {
+            nurbs.Draw();
+        } else if (cached) {
+            cache.Draw();
+        } else {
+            surface.Draw();
+        }
         glBindTexture(GL_TEXTURE_2D, 0);
 
+        if (countTriangles) {
+            glEndQuery(GL_PRIMITIVES_GENERATED);
+            queryPending = true;
+        }
+
         // Draw control points
         if (showPoints) {
             pointShader->Use();
             glUniformMatrix4fv(glGetUniformLocation(pointShader->Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
             glUniformMatrix4fv(glGetUniformLocation(pointShader->Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
             glUniformMatrix4fv(glGetUniformLocation(pointShader->Program(), "model"), 1, GL_FALSE, glm::value_ptr(model));
+            glUniform1i(glGetUniformLocation(pointShader->Program(), "selectedPoint"), dragSurface == shownSurface && !nurbsShown ? dragPoint : -1);
             glPointSize(5.0f);
-            glBindVertexArray(VAO);
-            glDrawArrays(GL_POINTS, 0, 25);
-            glBindVertexArray(0);
+            if (nurbsShown) {
+                nurbs.DrawPoints();
+            } else {
+                surface.DrawPoints();
+            }
         }
 
         if (showText) {
@@ -281,8 +520,23 @@ int main()
             );
 
             auto screenOrigin = glm::vec2{-static_cast<GLfloat>(screenWidth) / 2, -static_cast<GLfloat>(screenHeight) / 2};
-            arial.RenderText("Use W/A/S/D and mouse to control the camera.", screenOrigin.x + 25, screenOrigin.y + 145, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
-            arial.RenderText("Use X/Z to change the smoothness of the surface. Current level: " + std::to_string(level) + ".", screenOrigin.x + 25, screenOrigin.y + 115, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText("Patches: " + std::to_string(nurbsShown ? nurbs.Patches() : surface.Patches()) + ", triangles: " + std::to_string(triangles) + ", frame time: " + std::to_string(deltaTime * 1000.0f) + " ms.", screenOrigin.x + 25, screenOrigin.y + 445, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText("Press N to switch surfaces, O to show the NURBS torus instead. Current: " + (nurbsShown ? std::string("NURBS torus") : surfaceNames[shownSurface]) + ".", screenOrigin.x + 25, screenOrigin.y + 415, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press K to turn on/off C1 continuity of the terrain. Current: ") + (terrainC1 ? "on" : "off") + ".", screenOrigin.x + 25, screenOrigin.y + 385, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press L to switch between fixed and adaptive levels. Current: ") + (adaptiveLevels ? "adaptive" : "fixed") + ".", screenOrigin.x + 25, screenOrigin.y + 355, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press M to switch between GPU and CPU tessellation. Current: ") + (cpuTessellation ? "CPU" : "GPU") + ".", screenOrigin.x + 25, screenOrigin.y + 325, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press B to turn on/off lighting. Current: ") + (useLighting ? "on" : "off") + ".", screenOrigin.x + 25, screenOrigin.y + 295, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press G to switch between analytic and screen-space normals. Current: ") + (analyticNormals ? "analytic" : "screen-space") + ".", screenOrigin.x + 25, screenOrigin.y + 265, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press U to switch between computed and tabulated basis weights (fixed levels). Current: ") + (basisLookup ? "tabulated" : "computed") + ".", screenOrigin.x + 25, screenOrigin.y + 235, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText(std::string("Press F to turn on/off caching the tessellation (fixed levels). Current: ") + (cacheTessellation ? (cached ? "on, cached" : "on, not cached") : "off") + ".", screenOrigin.x + 25, screenOrigin.y + 205, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText("Use W/A/S/D and mouse to control the camera.", screenOrigin.x + 25, screenOrigin.y + 175, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            arial.RenderText("Hold the left button to drag the control point under the cross along with the camera.", screenOrigin.x + 25, screenOrigin.y + 145, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
+            if (showPoints) {
+                arial.RenderText("+", -6.0f, -8.0f, 0.5, UIprojection, glm::vec3{1.0f, 1.0f, 1.0f});
+            }
+            arial.RenderText(adaptiveLevels && !cpuTessellation
+                ? "Use X/Z to change the smoothness of the surface. Current triangle size: " + std::to_string(triangleSize) + " px."
+                : "Use X/Z to change the smoothness of the surface. Current level: " + std::to_string(level) + ".", screenOrigin.x + 25, screenOrigin.y + 115, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
             arial.RenderText("Press C to switch between face mode and wireframe mode.", screenOrigin.x + 25, screenOrigin.y + 85, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
             arial.RenderText("Press P to turn on/off showing control points.", screenOrigin.x + 25, screenOrigin.y + 55, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
             arial.RenderText("Press T to turn on/off showing this message.", screenOrigin.x + 25, screenOrigin.y + 25, 0.5, UIprojection, glm::vec3{0.8f, 0.7f, 0.3f});
@@ -293,9 +547,15 @@ int main()
 	}
 
 	// properly de-allocate all resources
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
+    for (auto& surface : surfaces) {
+        surface.ReleaseBuffers();
+    }
     glDeleteTextures(1, &texture);
+    glDeleteQueries(1, &trianglesQuery);
+    cpuMesh.ReleaseBuffers();
+    nurbs.ReleaseBuffers();
+    basisTable.ReleaseBuffers();
+    cache.ReleaseBuffers();
 
 	glfwTerminate();
 	return 0;
@@ -312,6 +572,28 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
         showPoints = !showPoints;
     } else if (key == GLFW_KEY_T && action == GLFW_PRESS) {
         showText = !showText;
+    } else if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        currentSurface = (currentSurface + 1) % int(surfaces.size());
+        dragPoint = -1;
+    } else if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+        terrainC1 = !terrainC1;
+        rebuildTerrain = true;
+    } else if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        adaptiveLevels = !adaptiveLevels;
+    } else if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        // the GPU path only if the tessellation shaders could be built
+        cpuTessellation = !cpuTessellation || !hasTessellation;
+    } else if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        useLighting = !useLighting;
+    } else if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        analyticNormals = !analyticNormals;
+    } else if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        basisLookup = !basisLookup;
+    } else if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        showNurbs = !showNurbs;
+        dragPoint = -1;
+    } else if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+        cacheTessellation = !cacheTessellation;
     } else if (key >= 0 && key < 1024) {
         if (action == GLFW_PRESS) {
             keys[key] = true;
@@ -356,6 +638,33 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(GLfloat(yoffset));
 }
 
+// Picks the control point nearest to the camera close to the view ray (the center of the screen),
+// and drags it along with the camera while the left button is held.
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button != GLFW_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+    if (action == GLFW_RELEASE) {
+        dragPoint = -1;
+        return;
+    }
+    if (action != GLFW_PRESS || !showPoints || nurbsShown) {
+        return;
+    }
+
+    // the model matrix is the identity, control points are in world space
+    const glm::vec3 origin = camera.Position(), direction = camera.Front();
+    const int picked = surfaces[shownSurface].Pick(origin, direction, PICK_ANGLE);
+    if (picked >= 0) {
+        const glm::vec3 point = surfaces[shownSurface].ControlPoints()[picked];
+        dragSurface = shownSurface;
+        dragPoint = picked;
+        dragDistance = glm::dot(point - origin, direction);
+        dragOffset = point - (origin + direction * dragDistance);
+    }
+}
+
 void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
     screenWidth = width;
@@ -366,20 +675,30 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 
 void changeScale(GLfloat deltaTime)
 {
-    if (keys[GLFW_KEY_Z] && level > 1) {
-        if (level <= 20.0f)
-            level -= deltaTime * 5.0f;
-        else
-            level -= deltaTime * 10.0f;
-        level = level <= 1.0f ? 1.0f : level;
-    }
+    if (adaptiveLevels && !cpuTessellation) {
+        // smaller triangles make a smoother surface
+        if (keys[GLFW_KEY_Z]) {
+            triangleSize = glm::min(triangleSize + deltaTime * 10.0f, 64.0f);
+        }
+        if (keys[GLFW_KEY_X]) {
+            triangleSize = glm::max(triangleSize - deltaTime * 10.0f, 2.0f);
+        }
+    } else {
+        if (keys[GLFW_KEY_Z] && level > 1) {
+            if (level <= 20.0f)
+                level -= deltaTime * 5.0f;
+            else
+                level -= deltaTime * 10.0f;
+            level = level <= 1.0f ? 1.0f : level;
+        }
 
-    if (keys[GLFW_KEY_X] && level < 40) {
-        if (level < 20.0f)
-            level += deltaTime * 5.0f;
-        else
-            level += deltaTime * 10.0f;
-        level = level >= 40.0f ? 40.0f : level;
+        if (keys[GLFW_KEY_X] && level < 40) {
+            if (level < 20.0f)
+                level += deltaTime * 5.0f;
+            else
+                level += deltaTime * 10.0f;
+            level = level >= 40.0f ? 40.0f : level;
+        }
     }
 
     if (keys[GLFW_KEY_C]) {
@@ -387,3 +706,395 @@ void changeScale(GLfloat deltaTime)
         keys[GLFW_KEY_C] = false;
     }
 }
+
+void buildTerrain(Surface& terrain)
+{
+    terrain.MakeTerrain(TERRAIN_POINTS, TERRAIN_POINTS, 40.0f, 3.0f, 2021);
+    if (terrainC1) {
+        terrain.EnforceC1();
+    }
+}
+
+// A torus as a surface of revolution of two rational quadratic circles (9 control points each,
+// the corners weighted by sqrt(2) / 2), with a window and two round holes trimmed away.
+void buildNurbs(NurbsSurface& surface)
+{
+    const float R = 1.5f, r = 0.5f;
+    const float corner = std::sqrt(2.0f) / 2.0f;
+    const glm::vec2 circle[9] = {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}, {1, 0}};
+    const float circleWeights[9] = {1, corner, 1, corner, 1, corner, 1, corner, 1};
+    const std::vector<float> knots = {0, 0, 0, 0.25f, 0.25f, 0.5f, 0.5f, 0.75f, 0.75f, 1, 1, 1};
+
+    // u around the axis, v around the tube
+    std::vector<glm::vec3> net(81);
+    std::vector<float> weights(81);
+    for (int j = 0; j < 9; j++) {
+        for (int i = 0; i < 9; i++) {
+            const float radius = R + r * circle[j].x;
+            net[j * 9 + i] = glm::vec3{circle[i].x * radius, 1.0f + r * circle[j].y, -2.0f + circle[i].y * radius};
+            weights[j * 9 + i] = circleWeights[i] * circleWeights[j];
+        }
+    }
+    surface.Set(2, 2, knots, knots, 9, 9, net, weights);
+
+    // the whole domain is kept, and every loop inside it cuts a hole (even-odd)
+    surface.ClearTrimLoops();
+    surface.AddTrimLoop({{0, 0}, {1, 0}, {1, 1}, {0, 1}});
+    surface.AddTrimLoop({{0.05f, 0.3f}, {0.2f, 0.3f}, {0.2f, 0.7f}, {0.05f, 0.7f}});
+    for (const glm::vec2 center : {glm::vec2{0.45f, 0.5f}, glm::vec2{0.75f, 0.25f}}) {
+        std::vector<glm::vec2> hole;
+        for (int k = 0; k < 48; k++) {
+            const float angle = glm::radians(7.5f * float(k));
+            hole.push_back(center + 0.12f * glm::vec2{std::cos(angle), std::sin(angle)});
+        }
+        surface.AddTrimLoop(hole);
+    }
+    surface.Build();
+}
+
+/* ======================== benchmarks (--bench) ======================== */
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Sets the uniforms the tessellation stages read, for a fixed level and no lighting.
+void setTessellation(const Shader& shader, float tessLevel, const glm::mat4& view, const glm::mat4& projection)
+{
+    shader.Use();
+    glUniform1f(glGetUniformLocation(shader.Program(), "uOuter02"), tessLevel);
+    glUniform1f(glGetUniformLocation(shader.Program(), "uOuter13"), tessLevel);
+    glUniform1f(glGetUniformLocation(shader.Program(), "uInner0"), tessLevel);
+    glUniform1f(glGetUniformLocation(shader.Program(), "uInner1"), tessLevel);
+    glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "model"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1)));
+    glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(shader.Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform2f(glGetUniformLocation(shader.Program(), "viewport"), GLfloat(screenWidth), GLfloat(screenHeight));
+    glUniform1f(glGetUniformLocation(shader.Program(), "triangleSize"), triangleSize);
+    glUniform1i(glGetUniformLocation(shader.Program(), "adaptive"), 0);
+    glUniform1i(glGetUniformLocation(shader.Program(), "analyticNormals"), 1);
+    glUniform1i(glGetUniformLocation(shader.Program(), "useBasisTable"), 0);
+    glUniform1i(glGetUniformLocation(shader.Program(), "useLighting"), 0);
+    glUniform1i(glGetUniformLocation(shader.Program(), "useTexture"), 0);
+}
+
+// Primitives generated by draw() and its time, CPU side up to glFinish() and GL_TIME_ELAPSED,
+// averaged over frames after a first frame to warm up.
+struct FrameStats
+{
+    GLuint primitives;
+    double cpuMs;
+    double gpuMs;
+};
+
+template <typename F>
+FrameStats measureFrames(int frames, const F& draw)
+{
+    GLuint queries[2];
+    glGenQueries(2, queries);
+    FrameStats stats{0, 0.0, 0.0};
+    for (int f = 0; f <= frames; f++) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glFinish();
+        const auto start = std::chrono::steady_clock::now();
+        glBeginQuery(GL_PRIMITIVES_GENERATED, queries[0]);
+        glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+        draw();
+        glEndQuery(GL_TIME_ELAPSED);
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        glFinish();
+        const double ms = elapsedMs(start);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &ns);
+        glGetQueryObjectuiv(queries[0], GL_QUERY_RESULT, &stats.primitives);
+        if (f > 0) {
+            stats.cpuMs += ms / frames;
+            stats.gpuMs += double(ns) * 1e-6 / frames;
+        }
+    }
+    glDeleteQueries(2, queries);
+    return stats;
+}
+
+void benchPatch(const Shader* captureShader)
+{
+    // vertices per second of BezierPatch, the tables are built once for the resolution
+    BezierPatch patch(vertices);
+    const int resolution = 256;
+    const int runs = 100;
+    patch.Tessellate(resolution);
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < runs; r++) {
+        patch.Tessellate(resolution);
+    }
+    const double ms = elapsedMs(start);
+#ifdef __AVX2__
+    const char* path = "AVX2";
+#else
+    const char* path = "scalar";
+#endif
+    std::cout << "patch: " << path << ", " << patch.Vertices().size() << " vertices in " << ms / runs << " ms, "
+              << double(runs) * patch.Vertices().size() / ms * 1e-3 << " M vertices/s" << std::endl;
+
+    if (captureShader == nullptr) {
+        std::cout << "patch: no transform feedback, not compared with the TES" << std::endl;
+        return;
+    }
+
+    // every vertex the TES outputs for the single patch, found in the CPU grid by its texture coordinates
+    const int tessLevel = 16;
+    patch.Tessellate(tessLevel);
+    const size_t count = size_t(2 * tessLevel * tessLevel * 3);
+    std::vector<BezierPatch::Vertex> captured(count);
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, buffer);
+    glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, count * sizeof(BezierPatch::Vertex), nullptr, GL_STATIC_READ);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer);
+    setTessellation(*captureShader, float(tessLevel), camera.ViewMatrix(), glm::mat4(1));
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_TRIANGLES);
+    surfaces[0].Draw();
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, count * sizeof(BezierPatch::Vertex), captured.data());
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDeleteBuffers(1, &buffer);
+
+    float positionError = 0.0f, normalError = 0.0f;
+    for (const auto& vertex : captured) {
+        const int col = int(std::round(vertex.texCoord.x * tessLevel));
+        const int row = int(std::round(vertex.texCoord.y * tessLevel));
+        const BezierPatch::Vertex& expected = patch.Vertices()[row * (tessLevel + 1) + col];
+        const glm::vec3 dp = glm::abs(vertex.position - expected.position);
+        const glm::vec3 dn = glm::abs(glm::normalize(vertex.normal) - expected.normal);
+        positionError = std::max(positionError, std::max(dp.x, std::max(dp.y, dp.z)));
+        normalError = std::max(normalError, std::max(dn.x, std::max(dn.y, dn.z)));
+    }
+    std::cout << "patch: level " << tessLevel << ", " << count << " captured TES vertices, max difference "
+              << positionError << " in positions, " << normalError << " in normals" << std::endl;
+}
+
+void benchLevels(const Shader& surfaceShader)
+{
+    // the single patch seen from further and further away, with a fixed level and with adaptive levels
+    const glm::vec3 center(0.0f, 0.5f, -2.0f);
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / float(screenHeight), 0.1f, 1000.0f);
+    const int fixedLevel = 16;
+    for (float distance : {2.0f, 8.0f, 32.0f, 128.0f}) {
+        const glm::mat4 view = glm::lookAt(center + distance * glm::vec3(0.0f, 0.5f, 1.0f), center, glm::vec3(0.0f, 1.0f, 0.0f));
+        for (bool adaptive : {false, true}) {
+            setTessellation(surfaceShader, float(fixedLevel), view, projection);
+            glUniform1i(glGetUniformLocation(surfaceShader.Program(), "adaptive"), adaptive);
+            const FrameStats stats = measureFrames(5, [] { surfaces[0].Draw(); });
+            std::cout << "levels: distance " << distance << ", "
+                      << (adaptive ? "adaptive, " + std::to_string(int(triangleSize)) + " px" : "fixed level " + std::to_string(fixedLevel))
+                      << ": " << stats.primitives << " triangles, " << stats.cpuMs << " ms, GPU timer " << stats.gpuMs << " ms" << std::endl;
+        }
+    }
+}
+
+void benchPatches(const Shader& surfaceShader)
+{
+    // building the terrain net, then all of its patches drawn in one call from above
+    Surface terrain;
+    const auto start = std::chrono::steady_clock::now();
+    buildTerrain(terrain);
+    std::cout << "patches: " << TERRAIN_POINTS << " x " << TERRAIN_POINTS << " terrain net built in " << elapsedMs(start) << " ms" << std::endl;
+
+    const Surface& drawn = surfaces[TERRAIN];
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 30.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / float(screenHeight), 0.1f, 1000.0f);
+    for (int tessLevel : {1, 2, 4}) {
+        setTessellation(surfaceShader, float(tessLevel), view, projection);
+        const FrameStats stats = measureFrames(3, [&] { drawn.Draw(); });
+        std::cout << "patches: " << drawn.Patches() << " patches at level " << tessLevel << ", " << stats.primitives << " triangles, "
+                  << stats.cpuMs << " ms per frame, " << drawn.Patches() / stats.cpuMs * 1e-3 << " M patches/s" << std::endl;
+    }
+}
+
+// Draws the surface with the rasterizer off, so only the vertex and tessellation stages run.
+void tessellateOnly(const Surface& surface)
+{
+    glEnable(GL_RASTERIZER_DISCARD);
+    surface.Draw();
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void benchDerivatives(const Shader& surfaceShader)
+{
+    // the evaluation shader over the whole terrain, with and without the derivatives for the normal
+    const Surface& terrain = surfaces[TERRAIN];
+    const int tessLevel = 4;
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 30.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / float(screenHeight), 0.1f, 1000.0f);
+    for (bool derivatives : {true, false}) {
+        setTessellation(surfaceShader, float(tessLevel), view, projection);
+        glUniform1i(glGetUniformLocation(surfaceShader.Program(), "analyticNormals"), derivatives);
+        const FrameStats stats = measureFrames(3, [&] { tessellateOnly(terrain); });
+        std::cout << "derivatives: " << (derivatives ? "with" : "without") << ", " << terrain.Patches() << " patches at level "
+                  << tessLevel << ", " << stats.primitives << " triangles, " << stats.cpuMs << " ms, GPU timer " << stats.gpuMs << " ms" << std::endl;
+    }
+}
+
+void benchBasis(const Shader& surfaceShader)
+{
+    // 5 x 5 patches at level 40, the Bernstein weights computed in the TES or looked up in the table
+    Surface grid;
+    grid.MakeTerrain(21, 21, 10.0f, 1.0f, 7);
+    grid.SetupBuffers();
+    grid.Upload();
+    const int tessLevel = 40;
+    basisTable.Update(tessLevel);
+    basisTable.Bind();
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 8.0f, 8.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / float(screenHeight), 0.1f, 1000.0f);
+    for (bool lookup : {false, true}) {
+        setTessellation(surfaceShader, float(tessLevel), view, projection);
+        glUniform1i(glGetUniformLocation(surfaceShader.Program(), "useBasisTable"), lookup);
+        glUniform1i(glGetUniformLocation(surfaceShader.Program(), "basisLevel"), basisTable.Level());
+        const FrameStats stats = measureFrames(5, [&] { tessellateOnly(grid); });
+        std::cout << "basis: " << (lookup ? "table" : "bernstein()") << ", " << grid.Patches() << " patches at level " << tessLevel
+                  << ", " << stats.primitives << " triangles, " << stats.cpuMs << " ms, GPU timer " << stats.gpuMs << " ms, "
+                  << stats.primitives / stats.cpuMs * 1e-3 << " M triangles/s" << std::endl;
+    }
+    grid.ReleaseBuffers();
+}
+
+void benchCache(const Shader& surfaceShader, const Shader& captureShader, const Shader& meshShader)
+{
+    // frames of the terrain at level 2: tessellated every frame, captured once and drawn again,
+    // and captured again every frame because a control point moves
+    Surface& terrain = surfaces[TERRAIN];
+    const int tessLevel = 2;
+    const int frames = 3;
+    const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 30.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / float(screenHeight), 0.1f, 1000.0f);
+    const auto capture = [&] {
+        setTessellation(captureShader, float(tessLevel), view, projection);
+        cache.Capture(terrain, tessLevel);
+    };
+    const auto drawCached = [&] {
+        setTessellation(meshShader, float(tessLevel), view, projection);
+        cache.Draw();
+    };
+
+    setTessellation(surfaceShader, float(tessLevel), view, projection);
+    const FrameStats live = measureFrames(frames, [&] { terrain.Draw(); });
+    capture();
+    const FrameStats still = measureFrames(frames, drawCached);
+    const int point = TERRAIN_POINTS * (TERRAIN_POINTS / 2) + TERRAIN_POINTS / 2;
+    const glm::vec3 original = terrain.ControlPoints()[point];
+    int edits = 0;
+    const FrameStats editing = measureFrames(frames, [&] {
+        terrain.SetPoint(point, original + glm::vec3(0.0f, 0.1f * float(++edits), 0.0f));
+        terrain.Upload();
+        capture();
+        drawCached();
+    });
+    terrain.SetPoint(point, original);
+    terrain.Upload();
+    cache.Invalidate();
+
+    std::cout << "cache: " << terrain.Patches() << " patches at level " << tessLevel << ", " << live.primitives << " triangles: live "
+              << live.cpuMs << " ms, cached and static " << still.cpuMs << " ms, cached and editing " << editing.cpuMs << " ms per frame" << std::endl;
+}
+
+void benchEdits()
+{
+    // 1000 random control points of a 100 x 100 patch grid moved one by one, each edit
+    // re-evaluating its patches on the CPU and uploading them and the point, as when dragging
+    Surface grid;
+    grid.MakeTerrain(401, 401, 40.0f, 3.0f, 11);
+    grid.SetupBuffers();
+    grid.Upload();
+    SurfaceMesh mesh;
+    mesh.SetupBuffers();
+    const int edits = 1000;
+    for (int resolution : {8, 16}) {
+        mesh.Build(grid, resolution);
+        glFinish();
+        std::mt19937 random(2021);
+        std::uniform_int_distribution<int> anyPoint(0, grid.Points() - 1);
+        std::uniform_real_distribution<float> offset(-0.1f, 0.1f);
+        const auto start = std::chrono::steady_clock::now();
+        for (int e = 0; e < edits; e++) {
+            const int point = anyPoint(random);
+            grid.SetPoint(point, grid.ControlPoints()[point] + glm::vec3(offset(random), offset(random), offset(random)));
+            mesh.UpdatePoint(grid, point);
+            grid.Upload();
+        }
+        glFinish();
+        const double ms = elapsedMs(start);
+        std::cout << "edits: " << grid.Patches() << " patches at level " << resolution << ", " << edits << " edits, "
+                  << ms / edits << " ms per edit, mesh " << (mesh.Covers(grid, resolution) ? "up to date" : "STALE") << std::endl;
+    }
+
+    // picking scans all points
+    const auto start = std::chrono::steady_clock::now();
+    const int picked = grid.Pick(camera.Position(), camera.Front(), PICK_ANGLE);
+    std::cout << "edits: picking among " << grid.Points() << " points took " << elapsedMs(start) << " ms (picked " << picked << ")" << std::endl;
+    mesh.ReleaseBuffers();
+    grid.ReleaseBuffers();
+}
+
+void benchNurbs(const Shader* nurbsShader)
+{
+    for (int degree : {3, 5}) {
+        // a wavy sheet of 100 x 100 spans with random weights and 20 round holes; degree 3 patches go
+        // through gl_in, degree 5 patches read their points from the buffer
+        const int spans = 100, points = spans + degree;
+        std::vector<float> knots(degree, 0.0f);
+        for (int k = 0; k <= spans; k++) {
+            knots.push_back(float(k) / spans);
+        }
+        knots.insert(knots.end(), degree, 1.0f);
+        std::mt19937 random(2021);
+        std::uniform_real_distribution<float> weight(0.5f, 2.0f), place(0.1f, 0.9f);
+        std::vector<glm::vec3> net(size_t(points) * points);
+        std::vector<float> weights(net.size());
+        for (int j = 0; j < points; j++) {
+            for (int i = 0; i < points; i++) {
+                const float x = 10.0f * float(i) / (points - 1) - 5.0f, z = 10.0f * float(j) / (points - 1) - 5.0f;
+                net[j * points + i] = glm::vec3{x, 0.5f * std::sin(x) * std::cos(z), z};
+                weights[j * points + i] = weight(random);
+            }
+        }
+        NurbsSurface sheet;
+        sheet.Set(degree, degree, knots, knots, points, points, net, weights);
+        sheet.AddTrimLoop({{0, 0}, {1, 0}, {1, 1}, {0, 1}});
+        for (int h = 0; h < 20; h++) {
+            const glm::vec2 center{place(random), place(random)};
+            std::vector<glm::vec2> hole;
+            for (int k = 0; k < 48; k++) {
+                const float angle = glm::radians(7.5f * float(k));
+                hole.push_back(center + 0.05f * glm::vec2{std::cos(angle), std::sin(angle)});
+            }
+            sheet.AddTrimLoop(hole);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        sheet.Build();
+        std::cout << "nurbs: " << spans * spans << " spans of degree " << degree << " converted in " << elapsedMs(start) << " ms, "
+                  << sheet.Patches() << " patches kept, " << sheet.MaskLayers() << " trimmed" << std::endl;
+        if (nurbsShader == nullptr) {
+            continue;
+        }
+
+        sheet.SetupBuffers();
+        sheet.Upload();
+        const glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 8.0f, 8.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        const glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / float(screenHeight), 0.1f, 1000.0f);
+        for (int tessLevel : {2, 4}) {
+            setTessellation(*nurbsShader, float(tessLevel), view, projection);
+            glUniform1i(glGetUniformLocation(nurbsShader->Program(), "degreeU"), degree);
+            glUniform1i(glGetUniformLocation(nurbsShader->Program(), "degreeV"), degree);
+            glUniform1i(glGetUniformLocation(nurbsShader->Program(), "pointsInBuffer"), sheet.PointsInBuffer());
+            const FrameStats stats = measureFrames(3, [&] { sheet.Draw(); });
+            std::cout << "nurbs: " << sheet.Patches() << (sheet.PointsInBuffer() ? " buffer" : " gl_in") << " patches at level "
+                      << tessLevel << ", " << stats.primitives << " triangles, " << stats.cpuMs << " ms per frame, " << sheet.Patches() / stats.cpuMs * 1e-3 << " M patches/s" << std::endl;
+        }
+        sheet.ReleaseBuffers();
+    }
+}
@@ -0,0 +1,32 @@
+/*
+ * GLSL Vertex Shader code for OpenGL version 4.6
+ */
+
+#version 460 core
+
+// input vertex attributes, tessellated on the CPU
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 vertexNormal;
+layout (location = 2) in vec2 vertexTexCoord;
+
+out vec2 texCoord;
+out vec3 fragPos;
+out vec3 normal;
+// not trimmed, see bezier.frag
+out vec2 patchCoord;
+flat out int trimLayer;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	fragPos = vec3(model * vec4(position, 1.0));
+	// model has no non-uniform scaling
+	normal = mat3(model) * vertexNormal;
+	gl_Position = projection * view * vec4(fragPos, 1.0);
+	texCoord = vertexTexCoord;
+	patchCoord = vec2(0.0);
+	trimLayer = -1;
+}
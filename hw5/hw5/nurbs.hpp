@@ -0,0 +1,424 @@
+#ifndef CG_NURBS_H_
+#define CG_NURBS_H_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace cg
+{
+/* A trimmed NURBS surface: rational B-spline of degree up to 5 in u and v, with trim loops in
+ * its parameter domain, drawn with the tessellation shaders nurbs.tesc and nurbs.tese.
+ *
+ * Control points are kept homogeneous, (w x, w y, w z, w), so the B-spline and its Bezier spans
+ * are plain polynomials in 4D and the division by w happens per tessellated vertex. Build() inserts
+ * knots (Boehm's algorithm) until every interior knot has full multiplicity, first along the rows
+ * and then along the columns. Then span (su, sv) is a rational Bezier patch of (degreeU + 1) x
+ * (degreeV + 1) points, which is uploaded on its own.
+ *
+ * Trim loops are closed polygons in the domain scaled to [0, 1] x [0, 1]; a point of the surface
+ * is kept if it is inside an odd number of them, everything is kept if there are none. Patches
+ * completely outside are dropped, patches crossed by a loop get a MASK_SIZE^2 layer in a texture
+ * array, filled on the CPU with scanlines, and the fragment shader discards where it is 0.
+ *
+ * Patches go through gl_in as PatchPoints() vertices, only patches with more than the 32 points a
+ * patch is guaranteed to hold are drawn as BUFFER_PATCH_VERTICES dummy vertices whose points the
+ * shaders read from the storage buffer by patch index.
+ *
+ * GL bindings: control points in storage buffer 0, the domain rectangle of each patch (origin,
+ * size) in 1, its mask layer (-1 for none) in 2, the masks on texture unit 1.
+*/
+class NurbsSurface
+{
+public:
+    static constexpr int MAX_DEGREE = 5;
+    static constexpr int MASK_SIZE = 64;
+    // GL_MAX_PATCH_VERTICES is at least 32, and nurbs.tesc outputs that many; only degree 5 x 5
+    // patches (36 points) have more, those are read from the storage buffer
+    static constexpr int MAX_PATCH_POINTS = 32;
+    // vertices per patch then, matching nurbs.vert; two, as llvmpipe mixes up the points of
+    // patches of a single vertex
+    static constexpr int BUFFER_PATCH_VERTICES = 2;
+    static constexpr GLuint MASK_UNIT = 1;
+
+    NurbsSurface() :
+        degreeU(0), degreeV(0), rows(0), cols(0), maskLayers(0),
+        VAO(0), pointSSBO(0), domainSSBO(0), layerSSBO(0), maskTexture(0)
+    {
+    }
+
+    virtual ~NurbsSurface() { }
+
+    /* Getters */
+    int DegreeU() const { return degreeU; }
+    int DegreeV() const { return degreeV; }
+    int PatchPoints() const { return (degreeU + 1) * (degreeV + 1); }
+    // whether a patch has more points than MAX_PATCH_POINTS, see Draw()
+    bool PointsInBuffer() const { return PatchPoints() > MAX_PATCH_POINTS; }
+    int Patches() const { return int(domains.size()); }
+    int MaskLayers() const { return maskLayers; }
+
+    // A rows x cols control net, row by row, u along a row, with a weight per point. The knot
+    // vectors must be clamped (end knots repeated degree + 1 times), with cols + degreeU + 1 and
+    // rows + degreeV + 1 knots, and no interior knot repeated more than degree times.
+    // Returns false, keeping the old surface, if they are not.
+    bool Set(int degreeU, int degreeV, const std::vector<float>& knotsU, const std::vector<float>& knotsV,
+             int rows, int cols, const std::vector<glm::vec3>& net, const std::vector<float>& weights)
+    {
+        if (degreeU < 1 || degreeU > MAX_DEGREE || degreeV < 1 || degreeV > MAX_DEGREE
+            || rows <= degreeV || cols <= degreeU
+            || net.size() != size_t(rows) * cols || weights.size() != net.size()
+            || !validKnots(knotsU, degreeU, cols) || !validKnots(knotsV, degreeV, rows)) {
+            return false;
+        }
+        this->degreeU = degreeU;
+        this->degreeV = degreeV;
+        this->knotsU = knotsU;
+        this->knotsV = knotsV;
+        this->rows = rows;
+        this->cols = cols;
+        homogeneous.resize(net.size());
+        for (size_t k = 0; k < net.size(); k++) {
+            homogeneous[k] = glm::vec4{net[k] * weights[k], weights[k]};
+        }
+        return true;
+    }
+
+    void AddTrimLoop(const std::vector<glm::vec2>& loop)
+    {
+        if (loop.size() >= 3) {
+            trimLoops.push_back(loop);
+        }
+    }
+
+    void ClearTrimLoops()
+    {
+        trimLoops.clear();
+    }
+
+    // Splits the surface into Bezier patches and trims them, up to maxLayers masks (the rest of
+    // the crossed patches are not trimmed).
+    void Build(int maxLayers = 2048)
+    {
+        std::vector<float> spansU, spansV;
+        int refinedCols = 0, refinedRows = 0;
+        std::vector<glm::vec4> refined;
+        refineNet(refined, spansU, spansV, refinedCols, refinedRows);
+
+        points.clear();
+        domains.clear();
+        layers.clear();
+        masks.clear();
+        maskLayers = 0;
+
+        const float u0 = knotsU.front(), uRange = knotsU.back() - u0;
+        const float v0 = knotsV.front(), vRange = knotsV.back() - v0;
+        std::vector<uint8_t> mask(size_t(MASK_SIZE) * MASK_SIZE);
+        std::vector<glm::vec4> edges;
+        for (size_t sv = 0; sv + 1 < spansV.size(); sv++) {
+            // only the edges across this row of patches can change the parity of a point in it
+            const float bandLow = (spansV[sv] - v0) / vRange, bandHigh = (spansV[sv + 1] - v0) / vRange;
+            bandEdges(bandLow, bandHigh, edges);
+            for (size_t su = 0; su + 1 < spansU.size(); su++) {
+                const glm::vec4 domain{(spansU[su] - u0) / uRange, bandLow,
+                                       (spansU[su + 1] - spansU[su]) / uRange, bandHigh - bandLow};
+                int layer = -1;
+                if (trimLoops.empty()) {
+                    // kept
+                } else if (crosses(domain, edges)) {
+                    const int kept = rasterizeMask(domain, edges, mask.data());
+                    if (kept == 0) {
+                        continue;
+                    }
+                    if (kept < MASK_SIZE * MASK_SIZE && maskLayers < maxLayers) {
+                        layer = maskLayers++;
+                        masks.insert(masks.end(), mask.begin(), mask.end());
+                    }
+                } else if (!isKept(domain.x + domain.z * 0.5f, domain.y + domain.w * 0.5f, edges)) {
+                    continue;
+                }
+
+                for (int j = 0; j <= degreeV; j++) {
+                    for (int i = 0; i <= degreeU; i++) {
+                        points.push_back(refined[(sv * degreeV + j) * refinedCols + su * degreeU + i]);
+                    }
+                }
+                domains.push_back(domain);
+                layers.push_back(layer);
+            }
+        }
+    }
+
+    /* GL objects */
+    void SetupBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &pointSSBO);
+        glGenBuffers(1, &domainSSBO);
+        glGenBuffers(1, &layerSSBO);
+        glGenTextures(1, &maskTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, maskTexture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void ReleaseBuffers()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &pointSSBO);
+        glDeleteBuffers(1, &domainSSBO);
+        glDeleteBuffers(1, &layerSSBO);
+        glDeleteTextures(1, &maskTexture);
+        VAO = pointSSBO = domainSSBO = layerSSBO = maskTexture = 0;
+    }
+
+    // Copies the patches and the trim masks to the GL objects.
+    void Upload() const
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, points.size() * sizeof(glm::vec4), points.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, domainSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, domains.size() * sizeof(glm::vec4), domains.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, layerSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, layers.size() * sizeof(GLint), layers.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // a texture array needs at least one layer
+        const std::vector<uint8_t> empty(size_t(MASK_SIZE) * MASK_SIZE, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, maskTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, MASK_SIZE, MASK_SIZE, std::max(maskLayers, 1), 0, GL_RED, GL_UNSIGNED_BYTE,
+                     maskLayers > 0 ? masks.data() : empty.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // Draws all patches with the bound NURBS program, whose degreeU, degreeV and pointsInBuffer
+    // must be set.
+    void Draw() const
+    {
+        bindStorage();
+        glActiveTexture(GL_TEXTURE0 + MASK_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, maskTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(VAO);
+        if (PointsInBuffer()) {
+            glPatchParameteri(GL_PATCH_VERTICES, BUFFER_PATCH_VERTICES);
+            glDrawArrays(GL_PATCHES, 0, GLsizei(BUFFER_PATCH_VERTICES * Patches()));
+        } else {
+            glPatchParameteri(GL_PATCH_VERTICES, PatchPoints());
+            glDrawArrays(GL_PATCHES, 0, GLsizei(points.size()));
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0 + MASK_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Draws the control points of the Bezier patches.
+    void DrawPoints() const
+    {
+        bindStorage();
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_POINTS, 0, GLsizei(points.size()));
+        glBindVertexArray(0);
+    }
+
+private:
+    int degreeU, degreeV;
+    std::vector<float> knotsU, knotsV;
+    int rows, cols;
+    std::vector<glm::vec4> homogeneous;             // the control net, (w x, w y, w z, w)
+    std::vector<std::vector<glm::vec2>> trimLoops;
+
+    // built: PatchPoints() points per patch, row by row
+    std::vector<glm::vec4> points;
+    std::vector<glm::vec4> domains;                 // <vec2 origin, vec2 size> in [0, 1]^2
+    std::vector<GLint> layers;                      // mask layer of each patch, -1 if none
+    std::vector<uint8_t> masks;                     // MASK_SIZE^2 per layer, 255 kept, 0 trimmed
+    int maskLayers;
+
+    GLuint VAO, pointSSBO, domainSSBO, layerSSBO, maskTexture;
+
+    void bindStorage() const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, domainSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, layerSSBO);
+    }
+
+    static bool validKnots(const std::vector<float>& knots, int degree, int count)
+    {
+        if (knots.size() != size_t(count + degree + 1) || !(knots.front() < knots.back())) {
+            return false;
+        }
+        int multiplicity = 1;
+        for (size_t k = 1; k < knots.size(); k++) {
+            if (knots[k] < knots[k - 1]) {
+                return false;
+            }
+            multiplicity = knots[k] == knots[k - 1] ? multiplicity + 1 : 1;
+            const bool end = knots[k] == knots.front() || knots[k] == knots.back();
+            if (!end && multiplicity > degree) {
+                return false;
+            }
+        }
+        // clamped
+        return std::count(knots.begin(), knots.end(), knots.front()) == degree + 1
+            && std::count(knots.begin(), knots.end(), knots.back()) == degree + 1;
+    }
+
+    // Inserts knot t once into a curve (Boehm); span: knots[span] <= t < knots[span + 1],
+    // multiplicity: how often t is already a knot.
+    static void insertKnot(int degree, const std::vector<float>& knots, int span, int multiplicity, float t,
+                           std::vector<glm::vec4>& curve)
+    {
+        std::vector<glm::vec4> next(curve.size() + 1);
+        for (int i = 0; i <= span - degree; i++) {
+            next[i] = curve[i];
+        }
+        for (int i = span - degree + 1; i <= span - multiplicity; i++) {
+            const float a = (t - knots[i]) / (knots[i + degree] - knots[i]);
+            next[i] = (1.0f - a) * curve[i - 1] + a * curve[i];
+        }
+        for (int i = span - multiplicity + 1; i < int(next.size()); i++) {
+            next[i] = curve[i - 1];
+        }
+        curve.swap(next);
+    }
+
+    // Refines a curve until every interior knot has multiplicity degree. Then segment s of the
+    // curve is a Bezier curve of the points s * degree .. s * degree + degree, between the distinct
+    // knots spans[s] and spans[s + 1].
+    static void toBezier(int degree, std::vector<float> knots, std::vector<glm::vec4>& curve, std::vector<float>& spans)
+    {
+        spans.assign(1, knots.front());
+        size_t k = degree + 1;
+        while (k < knots.size()) {
+            const float t = knots[k];
+            int multiplicity = 0;
+            while (k + multiplicity < knots.size() && knots[k + multiplicity] == t) {
+                multiplicity++;
+            }
+            spans.push_back(t);
+            if (t == knots.back()) {
+                break;
+            }
+            // t is in [knots[span], knots[span + 1]) with span the last of its copies
+            const int span = int(k) + multiplicity - 1;
+            for (int inserted = 0; multiplicity + inserted < degree; inserted++) {
+                insertKnot(degree, knots, span + inserted, multiplicity + inserted, t, curve);
+                knots.insert(knots.begin() + span + inserted + 1, t);
+            }
+            k += degree;
+        }
+    }
+
+    // The control net refined to Bezier spans, first each row in u, then each column in v.
+    void refineNet(std::vector<glm::vec4>& refined, std::vector<float>& spansU, std::vector<float>& spansV,
+                   int& refinedCols, int& refinedRows) const
+    {
+        std::vector<std::vector<glm::vec4>> rowCurves(rows);
+        for (int r = 0; r < rows; r++) {
+            rowCurves[r].assign(homogeneous.begin() + size_t(r) * cols, homogeneous.begin() + size_t(r + 1) * cols);
+            toBezier(degreeU, knotsU, rowCurves[r], spansU);
+        }
+        refinedCols = int(rowCurves[0].size());
+
+        std::vector<glm::vec4> column(rows);
+        for (int c = 0; c < refinedCols; c++) {
+            column.resize(rows);
+            for (int r = 0; r < rows; r++) {
+                column[r] = rowCurves[r][c];
+            }
+            toBezier(degreeV, knotsV, column, spansV);
+            if (c == 0) {
+                refinedRows = int(column.size());
+                refined.resize(size_t(refinedRows) * refinedCols);
+            }
+            for (int r = 0; r < refinedRows; r++) {
+                refined[size_t(r) * refinedCols + c] = column[r];
+            }
+        }
+    }
+
+    // The edges <a, b> of all trim loops whose v range overlaps [low, high].
+    void bandEdges(float low, float high, std::vector<glm::vec4>& edges) const
+    {
+        edges.clear();
+        for (const auto& loop : trimLoops) {
+            for (size_t k = 0, last = loop.size() - 1; k < loop.size(); last = k++) {
+                const glm::vec2 a = loop[last], b = loop[k];
+                if (std::max(a.y, b.y) >= low && std::min(a.y, b.y) <= high) {
+                    edges.push_back(glm::vec4{a.x, a.y, b.x, b.y});
+                }
+            }
+        }
+    }
+
+    // Even-odd rule, counting the edges crossed by a ray in +u.
+    static bool isKept(float u, float v, const std::vector<glm::vec4>& edges)
+    {
+        bool inside = false;
+        for (const auto& e : edges) {
+            if ((e.y <= v) != (e.w <= v) && u < e.x + (v - e.y) / (e.w - e.y) * (e.z - e.x)) {
+                inside = !inside;
+            }
+        }
+        return inside;
+    }
+
+    // Whether any edge has its bounding box over the domain rectangle.
+    static bool crosses(const glm::vec4& domain, const std::vector<glm::vec4>& edges)
+    {
+        for (const auto& e : edges) {
+            if (std::max(e.x, e.z) >= domain.x && std::min(e.x, e.z) <= domain.x + domain.z
+                && std::max(e.y, e.w) >= domain.y && std::min(e.y, e.w) <= domain.y + domain.w) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Fills the mask of a domain rectangle at texel centers, one scanline per row: the crossings
+    // of the edges with the row are sorted and a texel is kept if an odd number of them are to
+    // its right, as in isKept(). Returns the number of kept texels.
+    static int rasterizeMask(const glm::vec4& domain, const std::vector<glm::vec4>& edges, uint8_t* mask)
+    {
+        int kept = 0;
+        std::vector<float> crossings;
+        for (int y = 0; y < MASK_SIZE; y++) {
+            const float v = domain.y + (float(y) + 0.5f) / MASK_SIZE * domain.w;
+            crossings.clear();
+            for (const auto& e : edges) {
+                if ((e.y <= v) != (e.w <= v)) {
+                    crossings.push_back(e.x + (v - e.y) / (e.w - e.y) * (e.z - e.x));
+                }
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            size_t passed = 0;
+            for (int x = 0; x < MASK_SIZE; x++) {
+                const float u = domain.x + (float(x) + 0.5f) / MASK_SIZE * domain.z;
+                while (passed < crossings.size() && crossings[passed] <= u) {
+                    passed++;
+                }
+                const bool inside = (crossings.size() - passed) % 2 == 1;
+                mask[y * MASK_SIZE + x] = inside ? 255 : 0;
+                kept += inside ? 1 : 0;
+            }
+        }
+        return kept;
+    }
+};
+
+} /* namespace cg */
+
+#endif /* CG_NURBS_H_ */
@@ -0,0 +1,27 @@
+/*
+ * GLSL Vertex Shader code for OpenGL version 4.6
+ */
+
+#version 460 core
+
+// the homogeneous control points of all patches, PatchPoints() per patch, see nurbs.tesc
+layout (std430, binding = 0) readonly buffer ControlPoints
+{
+	vec4 points[];
+};
+
+uniform int degreeU, degreeV;
+uniform bool pointsInBuffer;
+uniform mat4 model;
+
+// the patch this vertex belongs to, passed on instead of relying on gl_PrimitiveID in the
+// tessellation stages, which some drivers (llvmpipe) do not count across the whole draw
+flat out int vertexPatch;
+
+void main()
+{
+	// an affine model matrix commutes with the weight
+	gl_Position = model * points[gl_VertexID];
+	// NurbsSurface::BUFFER_PATCH_VERTICES per patch if its points are in the buffer
+	vertexPatch = gl_VertexID / (pointsInBuffer ? 2 : (degreeU + 1) * (degreeV + 1));
+}
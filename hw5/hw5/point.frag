@@ -4,9 +4,14 @@
 
 #version 460 core
 
+flat in int selected;
 out vec4 color;
 
 void main()
 {
-	color = vec4(1.0f, 0.5f, 0.2f, 1.0f);
+	if (selected != 0) {
+		color = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	} else {
+		color = vec4(1.0f, 0.5f, 0.2f, 1.0f);
+	}
 }
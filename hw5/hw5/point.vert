@@ -0,0 +1,26 @@
+/*
+ * GLSL Vertex Shader code for OpenGL version 4.6
+ */
+
+#version 460 core
+
+layout (std430, binding = 0) readonly buffer ControlPoints
+{
+	vec4 points[];
+};
+
+// the control point being dragged, -1 if none
+uniform int selectedPoint;
+flat out int selected;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	// homogeneous for NURBS, w is 1 otherwise
+	vec4 point = points[gl_VertexID];
+	gl_Position = projection * view * model * vec4(point.xyz / point.w, 1.0);
+	selected = int(gl_VertexID == selectedPoint);
+}
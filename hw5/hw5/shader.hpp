@@ -5,6 +5,7 @@
 #include <fstream>
 #include <sstream>
 #include <memory>
+#include <vector>
 
 #include <glad/glad.h>
 
@@ -71,7 +72,9 @@ public:
 		return std::unique_ptr<Shader>(new Shader(program));
 	}
 
-	static std::unique_ptr<Shader> Create(const char* const vertexFilename, const char* const fragmentFilename, const char* const tcsFilename, const char* const tesFilename)
+	// feedbackVaryings: outputs of the last vertex stage captured by transform feedback, interleaved in this order
+	static std::unique_ptr<Shader> Create(const char* const vertexFilename, const char* const fragmentFilename, const char* const tcsFilename, const char* const tesFilename,
+		const std::vector<const char*>& feedbackVaryings = {})
 	{
 		// Build and compile our shader programs
 
@@ -115,6 +118,9 @@ public:
 		glAttachShader(program, fragmentShader);
 		glAttachShader(program, tcsShader);
 		glAttachShader(program, tesShader);
+		if (!feedbackVaryings.empty()) {
+			glTransformFeedbackVaryings(program, GLsizei(feedbackVaryings.size()), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+		}
 		glLinkProgram(program);
 
 		// release input shaders
@@ -0,0 +1,428 @@
+#ifndef CG_SURFACE_H_
+#define CG_SURFACE_H_
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace cg
+{
+/* A surface made of many biquartic Bezier patches (5x5 control points each) that share their
+ * control points, drawn with one call.
+ *
+ * All control points are stored once, in a shader storage buffer (binding 0) read by the vertex
+ * shader with gl_VertexID. An index buffer lists the 25 control points of each patch, so
+ * neighbouring patches use the same border points and the surface is C0 by construction. The
+ * texture rectangle of each patch is in a second buffer (binding 1), indexed by gl_PrimitiveID.
+ *
+ * A surface is either a grid of (4m + 1) x (4n + 1) control points split into m x n patches, or
+ * a list of patches loaded from a file. Bicubic patches are raised to degree 4 when loading,
+ * which does not change their shape.
+*/
+class Surface
+{
+public:
+    static constexpr int ORDER = 5;     // control points per side of a patch
+    static constexpr int DEGREE = ORDER - 1;
+    static constexpr int PATCH_POINTS = ORDER * ORDER;
+
+    Surface() :
+        rows(0), cols(0), reshaped(false), changedBegin(0), changedEnd(0), revision(0),
+        VAO(0), pointSSBO(0), patchSSBO(0), EBO(0)
+    {
+    }
+
+    virtual ~Surface() { }
+
+    /* Getters */
+    int Patches() const { return int(indices.size()) / PATCH_POINTS; }
+    int Points() const { return int(points.size()); }
+    bool IsGrid() const { return rows > 0; }
+    const std::vector<glm::vec3>& ControlPoints() const { return points; }
+    // PATCH_POINTS control point indices per patch, row by row
+    const std::vector<GLuint>& Indices() const { return indices; }
+    const std::vector<glm::vec4>& TexRects() const { return texRects; }
+    // changed since the last Upload()
+    bool Dirty() const { return reshaped || changedBegin < changedEnd; }
+    // number of changes, anything derived from the surface is stale when this changes
+    unsigned Revision() const { return revision; }
+
+    // Moves one control point, only its range of the GL buffer is uploaded again.
+    void SetPoint(int index, const glm::vec3& position)
+    {
+        points[index] = position;
+        markChanged(size_t(index), size_t(index) + 1);
+    }
+
+    // The control point nearest to the origin of a ray among those within maxAngle (radians) of
+    // it, -1 if there is none. direction must be normalized.
+    int Pick(const glm::vec3& origin, const glm::vec3& direction, float maxAngle) const
+    {
+        const float minCos = std::cos(maxAngle);
+        int picked = -1;
+        float nearest = 0.0f;
+        for (size_t k = 0; k < points.size(); k++) {
+            const glm::vec3 toPoint = points[k] - origin;
+            const float along = glm::dot(toPoint, direction);
+            // in front, and within the cone around the ray
+            if (along <= 0.0f || along * along < minCos * minCos * glm::dot(toPoint, toPoint)) {
+                continue;
+            }
+            if (picked < 0 || along < nearest) {
+                picked = int(k);
+                nearest = along;
+            }
+        }
+        return picked;
+    }
+
+    // A single patch, coords holds x, y, z of its 25 control points row by row.
+    void SetPatch(const GLfloat* coords)
+    {
+        std::vector<glm::vec3> net(PATCH_POINTS);
+        for (int k = 0; k < PATCH_POINTS; k++) {
+            net[k] = glm::vec3{coords[3 * k], coords[3 * k + 1], coords[3 * k + 2]};
+        }
+        SetGrid(ORDER, ORDER, net);
+    }
+
+    // A rows x cols control net, row by row, split into patches sharing their border rows and columns.
+    // rows and cols must be 4n + 1. The texture is repeated texRepeat times over the whole grid.
+    void SetGrid(int rows, int cols, const std::vector<glm::vec3>& net, float texRepeat = 1.0f)
+    {
+        this->rows = rows;
+        this->cols = cols;
+        points = net;
+        reshape();
+
+        const int patchRows = (rows - 1) / DEGREE, patchCols = (cols - 1) / DEGREE;
+        indices.clear();
+        indices.reserve(size_t(patchRows) * patchCols * PATCH_POINTS);
+        texRects.clear();
+        texRects.reserve(size_t(patchRows) * patchCols);
+        for (int pr = 0; pr < patchRows; pr++) {
+            for (int pc = 0; pc < patchCols; pc++) {
+                for (int j = 0; j < ORDER; j++) {
+                    for (int i = 0; i < ORDER; i++) {
+                        indices.push_back(GLuint((pr * DEGREE + j) * cols + pc * DEGREE + i));
+                    }
+                }
+                texRects.push_back(glm::vec4{float(pc), float(pr), 1.0f, 1.0f} * texRepeat
+                                   / glm::vec4{float(patchCols), float(patchRows), float(patchCols), float(patchRows)});
+            }
+        }
+    }
+
+    // A rows x cols grid of rolling hills over a size x size square centered at the origin,
+    // heights from -height / 2 to height / 2, from a few octaves of value noise.
+    void MakeTerrain(int rows, int cols, float size, float height, uint32_t seed)
+    {
+        std::vector<glm::vec3> net(size_t(rows) * cols);
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                const float x = (float(c) / float(cols - 1) - 0.5f) * size;
+                const float z = (float(r) / float(rows - 1) - 0.5f) * size;
+                float h = 0.0f, amplitude = 0.5f, frequency = 4.0f / size;
+                for (int octave = 0; octave < 5; octave++) {
+                    h += amplitude * valueNoise(x * frequency, z * frequency, seed + uint32_t(octave));
+                    amplitude *= 0.5f;
+                    frequency *= 2.0f;
+                }
+                net[size_t(r) * cols + c] = glm::vec3{x, (h - 0.5f) * height, z};
+            }
+        }
+        SetGrid(rows, cols, net, float((cols - 1) / DEGREE) / 4.0f);
+    }
+
+    // Loads patches from a text file: the number of patches, then a line with the 16 (bicubic) or
+    // 25 (biquartic) 1-based control point indices of each patch, row by row, then the number of
+    // points and a line with x, y, z of each point. Numbers are separated by spaces or commas.
+    // Returns false if the file cannot be read or is malformed, the surface is left as it was then.
+    bool Load(const std::string& file)
+    {
+        std::ifstream in(file);
+        if (!in) {
+            return false;
+        }
+        std::vector<std::string> lines;
+        std::string line;
+        while (std::getline(in, line)) {
+            std::replace(line.begin(), line.end(), ',', ' ');
+            if (line.find_first_not_of(" \t\r") != std::string::npos) {
+                lines.push_back(line);
+            }
+        }
+
+        size_t next = 0;
+        int numPatches = 0;
+        if (next >= lines.size() || !(std::istringstream(lines[next++]) >> numPatches) || numPatches <= 0) {
+            return false;
+        }
+        std::vector<std::vector<int>> patchIndices(numPatches);
+        for (auto& patch : patchIndices) {
+            if (next >= lines.size()) {
+                return false;
+            }
+            std::istringstream fields(lines[next++]);
+            int index;
+            while (fields >> index) {
+                patch.push_back(index - 1);
+            }
+            if (patch.size() != 16 && patch.size() != size_t(PATCH_POINTS)) {
+                return false;
+            }
+        }
+        int numPoints = 0;
+        if (next >= lines.size() || !(std::istringstream(lines[next++]) >> numPoints) || numPoints <= 0) {
+            return false;
+        }
+        for (const auto& patch : patchIndices) {
+            for (int index : patch) {
+                if (index < 0 || index >= numPoints) {
+                    return false;
+                }
+            }
+        }
+        std::vector<glm::vec3> loaded(numPoints);
+        for (auto& p : loaded) {
+            if (next >= lines.size() || !(std::istringstream(lines[next++]) >> p.x >> p.y >> p.z)) {
+                return false;
+            }
+        }
+
+        // nothing can fail from here on
+        rows = cols = 0;
+        reshape();
+        points.clear();
+        indices.clear();
+        texRects.clear();
+        // raised points on shared edges come out bit for bit the same in both patches, share them
+        std::map<std::tuple<float, float, float>, GLuint> shared;
+        for (const auto& patch : patchIndices) {
+            glm::vec3 net[PATCH_POINTS];
+            if (patch.size() == size_t(PATCH_POINTS)) {
+                for (int k = 0; k < PATCH_POINTS; k++) {
+                    net[k] = loaded[patch[k]];
+                }
+            } else {
+                glm::vec3 cubic[16];
+                for (int k = 0; k < 16; k++) {
+                    cubic[k] = loaded[patch[k]];
+                }
+                raiseDegree(cubic, net);
+            }
+            for (const auto& p : net) {
+                auto found = shared.emplace(std::make_tuple(p.x, p.y, p.z), GLuint(points.size()));
+                if (found.second) {
+                    points.push_back(p);
+                }
+                indices.push_back(found.first->second);
+            }
+            texRects.push_back(glm::vec4{0.0f, 0.0f, 1.0f, 1.0f});
+        }
+        return true;
+    }
+
+    // Makes a grid C1 across patch borders: each control point on a border is moved to the middle
+    // of its two neighbours across it, so the tangents on both sides are the same. Corner points
+    // satisfy both directions. Surfaces that are not grids are left as they are.
+    void EnforceC1()
+    {
+        if (!IsGrid()) {
+            return;
+        }
+        markChanged(0, points.size());
+        for (int r = 0; r < rows; r++) {
+            for (int c = DEGREE; c < cols - 1; c += DEGREE) {
+                at(r, c) = (at(r, c - 1) + at(r, c + 1)) * 0.5f;
+            }
+        }
+        for (int r = DEGREE; r < rows - 1; r += DEGREE) {
+            for (int c = 0; c < cols; c++) {
+                at(r, c) = (at(r - 1, c) + at(r + 1, c)) * 0.5f;
+            }
+        }
+    }
+
+    /* GL objects */
+    void SetupBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &pointSSBO);
+        glGenBuffers(1, &patchSSBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void ReleaseBuffers()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &pointSSBO);
+        glDeleteBuffers(1, &patchSSBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = pointSSBO = patchSSBO = EBO = 0;
+    }
+
+    // Copies the control points, patches and texture rectangles to the GL buffers. If only some
+    // control points moved since the last upload, only their range is copied.
+    void Upload()
+    {
+        if (!reshaped && changedBegin < changedEnd) {
+            std::vector<glm::vec4> padded(changedEnd - changedBegin);
+            for (size_t k = changedBegin; k < changedEnd; k++) {
+                padded[k - changedBegin] = glm::vec4{points[k], 1.0f};
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointSSBO);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(changedBegin * sizeof(glm::vec4)), padded.size() * sizeof(glm::vec4), padded.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            changedBegin = changedEnd = 0;
+            return;
+        }
+
+        // vec3 arrays are padded to vec4 in std430 buffers
+        std::vector<glm::vec4> padded(points.size());
+        for (size_t k = 0; k < points.size(); k++) {
+            padded[k] = glm::vec4{points[k], 1.0f};
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, padded.size() * sizeof(glm::vec4), padded.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, patchSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, texRects.size() * sizeof(glm::vec4), texRects.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glBindVertexArray(VAO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        reshaped = false;
+        changedBegin = changedEnd = 0;
+    }
+
+    // Draws all patches with the bound tessellation program.
+    void Draw() const
+    {
+        bindStorage();
+        glBindVertexArray(VAO);
+        glPatchParameteri(GL_PATCH_VERTICES, PATCH_POINTS);
+        glDrawElements(GL_PATCHES, GLsizei(indices.size()), GL_UNSIGNED_INT, nullptr);
+        glBindVertexArray(0);
+    }
+
+    // Draws every control point once as a point.
+    void DrawPoints() const
+    {
+        bindStorage();
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_POINTS, 0, GLsizei(points.size()));
+        glBindVertexArray(0);
+    }
+
+private:
+    std::vector<glm::vec3> points;
+    std::vector<GLuint> indices;        // PATCH_POINTS per patch, row by row
+    std::vector<glm::vec4> texRects;    // <vec2 origin, vec2 size> of each patch in texture space
+    int rows, cols;                     // of the grid, 0 if not a grid
+
+    // not uploaded yet: everything if reshaped, else the control points [changedBegin, changedEnd)
+    bool reshaped;
+    size_t changedBegin, changedEnd;
+    unsigned revision;
+
+    GLuint VAO;
+    GLuint pointSSBO;
+    GLuint patchSSBO;
+    GLuint EBO;
+
+    void reshape()
+    {
+        reshaped = true;
+        revision++;
+    }
+
+    void markChanged(size_t begin, size_t end)
+    {
+        if (changedBegin < changedEnd) {
+            begin = std::min(begin, changedBegin);
+            end = std::max(end, changedEnd);
+        }
+        changedBegin = begin;
+        changedEnd = end;
+        revision++;
+    }
+
+    glm::vec3& at(int r, int c)
+    {
+        return points[size_t(r) * cols + c];
+    }
+
+    void bindStorage() const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, patchSSBO);
+    }
+
+    // degree elevation of a 4x4 bicubic net to the 5x5 biquartic net of the same surface,
+    // first along the rows, then along the columns
+    static void raiseDegree(const glm::vec3* cubic, glm::vec3* quartic)
+    {
+        glm::vec3 rowsRaised[4 * ORDER];
+        for (int j = 0; j < 4; j++) {
+            for (int i = 0; i < ORDER; i++) {
+                rowsRaised[j * ORDER + i] = raised(cubic, j * 4, 1, i);
+            }
+        }
+        for (int j = 0; j < ORDER; j++) {
+            for (int i = 0; i < ORDER; i++) {
+                quartic[j * ORDER + i] = raised(rowsRaised, i, ORDER, j);
+            }
+        }
+    }
+
+    // point k of the degree 4 curve equal to the cubic curve p[first], p[first + stride], ...
+    static glm::vec3 raised(const glm::vec3* p, int first, int stride, int k)
+    {
+        const float t = float(k) / float(DEGREE);
+        if (k == 0) {
+            return p[first];
+        }
+        if (k == DEGREE) {
+            return p[first + 3 * stride];
+        }
+        return t * p[first + (k - 1) * stride] + (1.0f - t) * p[first + k * stride];
+    }
+
+    static float hash(int x, int y, uint32_t seed)
+    {
+        uint32_t h = uint32_t(x) * 374761393u + uint32_t(y) * 668265263u + seed * 2246822519u;
+        h = (h ^ (h >> 13)) * 1274126177u;
+        return float((h ^ (h >> 16)) & 0xffffffu) / float(0xffffff);
+    }
+
+    // smoothly interpolated random values at integer points, in [0, 1]
+    static float valueNoise(float x, float y, uint32_t seed)
+    {
+        const float fx = std::floor(x), fy = std::floor(y);
+        const int ix = int(fx), iy = int(fy);
+        float tx = x - fx, ty = y - fy;
+        tx = tx * tx * (3.0f - 2.0f * tx);
+        ty = ty * ty * (3.0f - 2.0f * ty);
+        const float a = hash(ix, iy, seed), b = hash(ix + 1, iy, seed);
+        const float c = hash(ix, iy + 1, seed), d = hash(ix + 1, iy + 1, seed);
+        return glm::mix(glm::mix(a, b, tx), glm::mix(c, d, tx), ty);
+    }
+};
+
+} /* namespace cg */
+
+#endif /* CG_SURFACE_H_ */
@@ -0,0 +1,219 @@
+#ifndef CG_SURFACEMESH_H_
+#define CG_SURFACEMESH_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bezier.hpp"
+#include "surface.hpp"
+
+namespace cg
+{
+/* All patches of a Surface tessellated on the CPU at the same resolution, in one vertex buffer
+ * with (resolution + 1)^2 vertices per patch, drawn with one call.
+ *
+ * Every patch is evaluated by the same BezierPatch, so its tables are built once per resolution.
+ * For each control point the patches using it are kept in compressed rows, so after moving one
+ * point only those patches (at most 4 on a grid) are evaluated again, and only their ranges of
+ * the vertex buffer are uploaded.
+*/
+class SurfaceMesh
+{
+public:
+    using Vertex = BezierPatch::Vertex;
+
+    // surfaces whose mesh would need more memory are not tessellated on the CPU
+    static constexpr uint64_t MAX_BYTES = uint64_t(256) << 20;
+
+    SurfaceMesh() :
+        evaluator(std::vector<GLfloat>(3 * BezierPatch::ORDER * BezierPatch::ORDER, 0.0f).data()),
+        surface(nullptr), revision(0), resolution(0), VAO(0), VBO(0), EBO(0)
+    {
+    }
+
+    virtual ~SurfaceMesh() { }
+
+    // Bytes of the vertices and indices of the surface at this resolution.
+    static uint64_t Bytes(const Surface& s, int resolution)
+    {
+        const uint64_t n = uint64_t(resolution) + 1;
+        return uint64_t(s.Patches()) * (n * n * sizeof(Vertex) + uint64_t(resolution) * resolution * 6 * sizeof(GLuint));
+    }
+
+    // Whether the mesh is the one of this surface, as it is now, at this resolution.
+    bool Covers(const Surface& s, int resolution) const
+    {
+        return surface == &s && revision == s.Revision() && this->resolution == resolution;
+    }
+
+    /* GL objects, vertex attributes: 0 position, 1 normal, 2 texCoord */
+    void SetupBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texCoord));
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void ReleaseBuffers()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+        surface = nullptr;
+    }
+
+    // Tessellates every patch of the surface and uploads the whole mesh.
+    void Build(const Surface& s, int newResolution)
+    {
+        surface = &s;
+        revision = s.Revision();
+        resolution = newResolution < 1 ? 1 : newResolution;
+
+        const int patches = s.Patches();
+        const int n = resolution + 1;
+        const size_t patchVertices = size_t(n) * n;
+        vertices.resize(patches * patchVertices);
+        for (int p = 0; p < patches; p++) {
+            evaluatePatch(p);
+        }
+
+        // the same grid for every patch, moved to its vertices
+        const std::vector<GLuint>& grid = evaluator.Indices();
+        indices.resize(patches * grid.size());
+        for (int p = 0; p < patches; p++) {
+            const GLuint base = GLuint(p * patchVertices);
+            for (size_t k = 0; k < grid.size(); k++) {
+                indices[p * grid.size() + k] = base + grid[k];
+            }
+        }
+
+        buildPointPatches();
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Evaluates again the patches using a control point that was just moved with
+    // Surface::SetPoint(), and uploads their vertices. If the mesh was already behind the surface
+    // before this edit, nothing is done and the mesh stays stale until the next Build().
+    void UpdatePoint(const Surface& s, int point)
+    {
+        if (surface != &s || revision + 1 != s.Revision()) {
+            return;
+        }
+        revision = s.Revision();
+
+        const size_t patchVertices = size_t(resolution + 1) * (resolution + 1);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        for (int k = pointPatchOffsets[point]; k < pointPatchOffsets[point + 1]; k++) {
+            const int p = pointPatches[k];
+            evaluatePatch(p);
+            glBufferSubData(GL_ARRAY_BUFFER, GLintptr(p * patchVertices * sizeof(Vertex)), patchVertices * sizeof(Vertex), &vertices[p * patchVertices]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void Draw() const
+    {
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, GLsizei(indices.size()), GL_UNSIGNED_INT, nullptr);
+        glBindVertexArray(0);
+    }
+
+private:
+    BezierPatch evaluator;
+    const Surface* surface;     // tessellated surface, nullptr if none
+    unsigned revision;
+    int resolution;
+
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    // patches using control point k: pointPatches[pointPatchOffsets[k] .. pointPatchOffsets[k + 1])
+    std::vector<int> pointPatchOffsets, pointPatches;
+
+    GLuint VAO, VBO, EBO;
+
+    // Tessellates patch p into its range of vertices, texture coordinates in its rectangle.
+    void evaluatePatch(int p)
+    {
+        const std::vector<glm::vec3>& points = surface->ControlPoints();
+        const GLuint* patch = &surface->Indices()[size_t(p) * Surface::PATCH_POINTS];
+        glm::vec3 net[Surface::PATCH_POINTS];
+        for (int k = 0; k < Surface::PATCH_POINTS; k++) {
+            net[k] = points[patch[k]];
+        }
+        evaluator.SetControlPoints(net);
+        evaluator.Tessellate(resolution);
+
+        const glm::vec4 rect = surface->TexRects()[p];
+        const std::vector<Vertex>& patchVertices = evaluator.Vertices();
+        Vertex* out = &vertices[p * patchVertices.size()];
+        for (size_t k = 0; k < patchVertices.size(); k++) {
+            out[k] = patchVertices[k];
+            out[k].texCoord = glm::vec2{rect.x, rect.y} + patchVertices[k].texCoord * glm::vec2{rect.z, rect.w};
+        }
+    }
+
+    // Counts the patches of every point, then lists them. A point used twice by a patch (e.g. at
+    // the poles of the teapot) lists it once.
+    void buildPointPatches()
+    {
+        const std::vector<GLuint>& patchIndices = surface->Indices();
+        const int numPoints = surface->Points();
+        const int patches = surface->Patches();
+        std::vector<int> lastPatch(numPoints, -1);
+
+        pointPatchOffsets.assign(size_t(numPoints) + 1, 0);
+        for (int p = 0; p < patches; p++) {
+            for (int k = 0; k < Surface::PATCH_POINTS; k++) {
+                const GLuint point = patchIndices[size_t(p) * Surface::PATCH_POINTS + k];
+                if (lastPatch[point] != p) {
+                    lastPatch[point] = p;
+                    pointPatchOffsets[point + 1]++;
+                }
+            }
+        }
+        for (int k = 0; k < numPoints; k++) {
+            pointPatchOffsets[k + 1] += pointPatchOffsets[k];
+        }
+
+        pointPatches.resize(pointPatchOffsets[numPoints]);
+        std::vector<int> next(pointPatchOffsets.begin(), pointPatchOffsets.end() - 1);
+        std::fill(lastPatch.begin(), lastPatch.end(), -1);
+        for (int p = 0; p < patches; p++) {
+            for (int k = 0; k < Surface::PATCH_POINTS; k++) {
+                const GLuint point = patchIndices[size_t(p) * Surface::PATCH_POINTS + k];
+                if (lastPatch[point] != p) {
+                    lastPatch[point] = p;
+                    pointPatches[next[point]++] = p;
+                }
+            }
+        }
+    }
+};
+
+} /* namespace cg */
+
+#endif /* CG_SURFACEMESH_H_ */
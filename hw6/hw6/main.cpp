@@ -3,6 +3,8 @@
  */
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <string>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -17,20 +19,14 @@
 #include FT_FREETYPE_H
 
 #include "camera.hpp"
+#include "jobs.hpp"
+#include "mesh.hpp"
 #include "obj.hpp"
 #include "shader.hpp"
 #include "text.hpp"
 
 using namespace cg;
 
-struct VertNorm
-{
-    Vertex vertex;
-    Vertex normal;
-    VertNorm(GLfloat x_, GLfloat y_, GLfloat z_, GLfloat nx_, GLfloat ny_, GLfloat nz_) : vertex{x_, y_, z_}, normal{nx_, ny_, nz_} {}
-    VertNorm(const Vertex& vert, const Vertex& norm) : vertex(vert), normal(norm) {}
-};
-
 constexpr const char* const OBJ_FILE = "eight.uniform.obj";
 
 constexpr glm::vec3 GLM_UP(0.0f, 1.0f, 0.0f);
@@ -101,6 +97,8 @@ GLfloat shininess = 32.0f;
 GLfloat scale = 1.0f;
 
 int useFaceNormal = 0;
+Mesh::Weighting weighting = Mesh::Weighting::AREA;
+bool cameraSpace = false;
 bool showText = true;
 
 Camera camera(glm::vec3{3, 3, 3}, glm::vec3{-1, -1, -1}, 2);
@@ -112,10 +110,18 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void moveCamera(GLfloat deltaTime);
 void changeLighting(GLfloat deltaTime);
-int bindData(GLuint VAO, GLuint VBO, const Obj& obj, const std::vector<Vertex>& normal);
 
-int main()
+double elapsedMs(std::chrono::steady_clock::time_point start);
+void makeGrid(Obj& obj, int side);
+void benchNormals(JobSystem& jobs);
+void benchUpload(JobSystem& jobs);
+void benchVertexStage(JobSystem& jobs, const Shader& lightingShader);
+
+int main(int argc, char* argv[])
 {
+	// with --bench, run the benchmarks in a hidden window and exit
+	const bool benchmark = argc > 1 && std::string(argv[1]) == "--bench";
+
 	// Setup a GLFW window
 
 	// init GLFW, set GL version & pipeline info
@@ -123,6 +129,7 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, benchmark ? GLFW_FALSE : GLFW_TRUE);
 
 	// create a window
 	GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Yifei Li - Assignment 6", nullptr, nullptr);
@@ -214,44 +221,20 @@ int main()
 
     // compute normals
 
-    std::vector<Vertex> avgNormals;
-    std::vector<Vertex> faceNormals;
-    avgNormals.resize(my_obj.vertices.size());
-    faceNormals.resize(my_obj.vertices.size());
-
-    int nf = my_obj.faces.size();
-    for (const TriFace& face : my_obj.faces) {
-        glm::vec3 p0(my_obj.vertices[face[0]]);
-        glm::vec3 p1(my_obj.vertices[face[1]]);
-        glm::vec3 p2(my_obj.vertices[face[2]]);
-        glm::vec3 a = p0 - p1, b = p1 - p2;
-        Vertex facenormal = Vertex(glm::cross(a, b));
-        // face normal
-        faceNormals[face[0]] = facenormal;
-        faceNormals[face[1]] = facenormal;
-        faceNormals[face[2]] = facenormal;
-        // average normal
-        avgNormals[face[0]] += facenormal;
-        avgNormals[face[1]] += facenormal;
-        avgNormals[face[2]] += facenormal;
-    }
+    // one worker per core builds the adjacency and computes the normals
+    JobSystem jobs;
+    Mesh mesh;
+    mesh.Build(my_obj, jobs);
+    mesh.ComputeNormals(jobs, weighting);
+    Mesh::Weighting meshWeighting = weighting;
 
 	// ---------------------------------------------------------------
 
 	// Set up vertex data (and buffer(s)) and attribute pointers
 
-	// bind VAO
-	GLuint avgVAO, faceVAO;
-    glGenVertexArrays(1, &avgVAO);
-    glGenVertexArrays(1, &faceVAO);
-
-	// bind VBO, buffer data to it
-    GLuint avgVBO, faceVBO;
-    glGenBuffers(1, &avgVBO);
-    glGenBuffers(1, &faceVBO);
-
-    int numAvgVertices = bindData(avgVAO, avgVBO, my_obj, avgNormals);
-    int numFaceVertices = bindData(faceVAO, faceVBO, my_obj, faceNormals);
+	// one indexed mesh for both modes, the face normals are fetched per primitive
+    mesh.SetupBuffers();
+    mesh.Upload();
 
     GLuint lampVAO;
     glGenVertexArrays(1, &lampVAO);
@@ -271,6 +254,17 @@ int main()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    if (benchmark) {
+        benchNormals(jobs);
+        benchUpload(jobs);
+        benchVertexStage(jobs, *lightingShader);
+        mesh.ReleaseBuffers();
+        glDeleteVertexArrays(1, &lampVAO);
+        glDeleteBuffers(1, &lampVBO);
+        glfwTerminate();
+        return 0;
+    }
+
 	// ---------------------------------------------------------------
 
 	// Define the viewport dimensions
@@ -292,12 +286,23 @@ int main()
 		/* your update code here */
         moveCamera(deltaTime);
         changeLighting(deltaTime);
+        if (meshWeighting != weighting) {
+            mesh.ComputeNormals(jobs, weighting);
+            meshWeighting = weighting;
+            mesh.UploadVertexNormals();
+        }
 
         auto projection = glm::perspective(glm::radians(camera.Zoom()), (GLfloat)screenWidth / (GLfloat)screenHeight, 0.1f, 100.0f);
         auto model = glm::scale(
             glm::mat4(1.0f),
             glm::vec3(scale)
         );
+        auto view = camera.ViewMatrix();
+        // the object goes to the space the lighting is done in, then to clip space; combined
+        // once per frame here instead of for every vertex
+        auto lightingModel = cameraSpace ? view * model : model;
+        auto lightingProjection = cameraSpace ? projection : projection * view;
+        auto normalMatrix = glm::transpose(glm::inverse(glm::mat3(lightingModel)));
         auto lampModel = glm::scale(
             glm::translate(glm::mat4(1.0f), lightPos),
             glm::vec3(LAMP_SCALE)
@@ -310,8 +315,13 @@ int main()
         lightingShader->Use();
         GLint lightPosLoc = glGetUniformLocation(lightingShader->Program(), "light.position");
         GLint viewPosLoc = glGetUniformLocation(lightingShader->Program(), "viewPos");
-        glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPos));
-        glUniform3fv(viewPosLoc, 1, glm::value_ptr(camera.Position()));
+        if (cameraSpace) {
+            glUniform3fv(lightPosLoc, 1, glm::value_ptr(glm::vec3(view * glm::vec4(lightPos, 1.0f))));
+            glUniform3f(viewPosLoc, 0.0f, 0.0f, 0.0f);
+        } else {
+            glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPos));
+            glUniform3fv(viewPosLoc, 1, glm::value_ptr(camera.Position()));
+        }
 
         // light properties
         glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f); // decrease the influence
@@ -334,30 +344,26 @@ int main()
         glUniform1f(matShineLoc, shininess);
 
         // Create camera transformations
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader->Program(), "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader->Program(), "view"), 1, GL_FALSE, glm::value_ptr(camera.ViewMatrix()));
-        glUniformMatrix4fv(glGetUniformLocation(lightingShader->Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(glGetUniformLocation(lightingShader->Program(), "lightingModel"), 1, GL_FALSE, glm::value_ptr(lightingModel));
+        glUniformMatrix4fv(glGetUniformLocation(lightingShader->Program(), "lightingProjection"), 1, GL_FALSE, glm::value_ptr(lightingProjection));
+
+        glUniformMatrix3fv(glGetUniformLocation(lightingShader->Program(), "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
         glUniform1i(glGetUniformLocation(lightingShader->Program(), "useFaceNormal"), useFaceNormal);
+        glUniform1i(glGetUniformLocation(lightingShader->Program(), "useFaceBuffer"), mesh.HasFaceBuffer());
+        glUniform1i(glGetUniformLocation(lightingShader->Program(), "faceNormals"), 0);
 
         // draw flat color for each face instead of interpolating
-        if (useFaceNormal) {
-            //glProvokingVertex(GL_FIRST_VERTEX_CONVENTION);
-            glBindVertexArray(faceVAO);
-            glDrawArrays(GL_TRIANGLES, 0, numFaceVertices);
-            glBindVertexArray(0);
-        } else {
-            glBindVertexArray(avgVAO);
-            glDrawArrays(GL_TRIANGLES, 0, numAvgVertices);
-            glBindVertexArray(0);
-        }
+        mesh.BindFaceNormals(GL_TEXTURE0);
+        mesh.Draw();
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
 
         // draw lamp
         lampShader->Use();
 
         // pass uniform values to shader
         glUniformMatrix4fv(glGetUniformLocation(lampShader->Program(), "model"), 1, GL_FALSE, glm::value_ptr(lampModel));
-        glUniformMatrix4fv(glGetUniformLocation(lampShader->Program(), "view"), 1, GL_FALSE, glm::value_ptr(camera.ViewMatrix()));
+        glUniformMatrix4fv(glGetUniformLocation(lampShader->Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
         glUniformMatrix4fv(glGetUniformLocation(lampShader->Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
         glUniform3fv(glGetUniformLocation(lampShader->Program(), "lightColor"), 1, glm::value_ptr(lightColor));
 
@@ -376,15 +382,17 @@ int main()
             );
 
             auto screenOrigin = glm::vec2{-static_cast<GLfloat>(screenWidth) / 2, -static_cast<GLfloat>(screenHeight) / 2};
-            arial.RenderText("Use [ or ] to change the scale of the object. Current scale: " + std::to_string(scale) + ".", screenOrigin.x + 25, screenOrigin.y + 295, 0.5, UIprojection, textColor);
-            arial.RenderText("Use W/A/S/D and mouse to control the camera.", screenOrigin.x + 25, screenOrigin.y + 265, 0.5, UIprojection, textColor);
-            arial.RenderText("Use UP/DOWN/LEFT/RIGHT ARROWs and X/Z to change the position of the lamp.", screenOrigin.x + 25, screenOrigin.y + 235, 0.5, UIprojection, textColor);
-            arial.RenderText("Press -/= to change shininess value of material. Current shininess: " + std::to_string(shininess) + ".", screenOrigin.x + 25, screenOrigin.y + 205, 0.5, UIprojection, textColor);
-            arial.RenderText("Press R/T to change the R value of material color.", screenOrigin.x + 25, screenOrigin.y + 175, 0.5, UIprojection, textColor);
-            arial.RenderText("Press G/H to change the G value of material color.", screenOrigin.x + 25, screenOrigin.y + 145, 0.5, UIprojection, textColor);
-            arial.RenderText("Press B/N to change the B value of material color.", screenOrigin.x + 25, screenOrigin.y + 115, 0.5, UIprojection, textColor);
-            arial.RenderText("Current material RGB: (" + std::to_string(materialColor.r) + "," + std::to_string(materialColor.g) + "," + std::to_string(materialColor.b) + ").", screenOrigin.x + 25, screenOrigin.y + 85, 0.5, UIprojection, textColor);
-            arial.RenderText("Press CTRL to switch between average normals and face normals.", screenOrigin.x + 25, screenOrigin.y + 55, 0.5, UIprojection, textColor);
+            arial.RenderText("Use [ or ] to change the scale of the object. Current scale: " + std::to_string(scale) + ".", screenOrigin.x + 25, screenOrigin.y + 355, 0.5, UIprojection, textColor);
+            arial.RenderText("Use W/A/S/D and mouse to control the camera.", screenOrigin.x + 25, screenOrigin.y + 325, 0.5, UIprojection, textColor);
+            arial.RenderText("Use UP/DOWN/LEFT/RIGHT ARROWs and X/Z to change the position of the lamp.", screenOrigin.x + 25, screenOrigin.y + 295, 0.5, UIprojection, textColor);
+            arial.RenderText("Press -/= to change shininess value of material. Current shininess: " + std::to_string(shininess) + ".", screenOrigin.x + 25, screenOrigin.y + 265, 0.5, UIprojection, textColor);
+            arial.RenderText("Press R/T to change the R value of material color.", screenOrigin.x + 25, screenOrigin.y + 235, 0.5, UIprojection, textColor);
+            arial.RenderText("Press G/H to change the G value of material color.", screenOrigin.x + 25, screenOrigin.y + 205, 0.5, UIprojection, textColor);
+            arial.RenderText("Press B/N to change the B value of material color.", screenOrigin.x + 25, screenOrigin.y + 175, 0.5, UIprojection, textColor);
+            arial.RenderText("Current material RGB: (" + std::to_string(materialColor.r) + "," + std::to_string(materialColor.g) + "," + std::to_string(materialColor.b) + ").", screenOrigin.x + 25, screenOrigin.y + 145, 0.5, UIprojection, textColor);
+            arial.RenderText("Press CTRL to switch between average normals and face normals.", screenOrigin.x + 25, screenOrigin.y + 115, 0.5, UIprojection, textColor);
+            arial.RenderText(std::string("Press M to weight average normals by face angle or area. Current: ") + (weighting == Mesh::Weighting::AREA ? "area" : "angle") + ".", screenOrigin.x + 25, screenOrigin.y + 85, 0.5, UIprojection, textColor);
+            arial.RenderText(std::string("Press C to switch lighting between world space and camera space. Current: ") + (cameraSpace ? "camera" : "world") + ".", screenOrigin.x + 25, screenOrigin.y + 55, 0.5, UIprojection, textColor);
             arial.RenderText("Press ALT to turn on/off showing this message.", screenOrigin.x + 25, screenOrigin.y + 25, 0.5, UIprojection, textColor);
         }
 
@@ -393,11 +401,8 @@ int main()
 	}
 
 	// properly de-allocate all resources
-    glDeleteVertexArrays(1, &faceVAO);
-    glDeleteVertexArrays(1, &avgVAO);
+    mesh.ReleaseBuffers();
     glDeleteVertexArrays(1, &lampVAO);
-    glDeleteBuffers(1, &faceVBO);
-    glDeleteBuffers(1, &avgVBO);
     glDeleteBuffers(1, &lampVBO);
 
 	glfwTerminate();
@@ -413,6 +418,10 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
         glfwSetWindowShouldClose(window, GL_TRUE);
     } else if ((key == GLFW_KEY_LEFT_CONTROL || key == GLFW_KEY_RIGHT_CONTROL) && action == GLFW_PRESS) {
         useFaceNormal = 1 - useFaceNormal;
+    } else if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        weighting = weighting == Mesh::Weighting::AREA ? Mesh::Weighting::ANGLE : Mesh::Weighting::AREA;
+    } else if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        cameraSpace = !cameraSpace;
     } else if ((key == GLFW_KEY_LEFT_ALT || key == GLFW_KEY_RIGHT_ALT) && action == GLFW_PRESS) {
         showText = !showText;
     } else if (key >= 0 && key < 1024) {
@@ -554,31 +563,199 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height)
     glViewport(0, 0, screenWidth, screenHeight);
 }
 
-int bindData(GLuint VAO, GLuint VBO, const Obj& obj, const std::vector<Vertex>& normal)
+/* ======================== benchmarks (--bench) ======================== */
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A side x side grid of vertices on a wavy sheet, 2 (side - 1)^2 triangles.
+void makeGrid(Obj& obj, int side)
 {
-    std::vector<VertNorm> data;
-    for (const auto& face : obj.faces) {
-        for (int i = 0; i < 3; i++) {
-            int vid = face[i];
-            data.emplace_back(obj.vertices[vid], normal[vid]);
+    obj.vertices.resize(size_t(side) * side);
+    for (int j = 0; j < side; j++) {
+        for (int i = 0; i < side; i++) {
+            const float x = 4.0f * float(i) / (side - 1) - 2.0f, z = 4.0f * float(j) / (side - 1) - 2.0f;
+            obj.vertices[size_t(j) * side + i] = Vertex(x, 0.3f * std::sin(3.0f * x) * std::cos(2.0f * z), z);
         }
     }
+    obj.faces.clear();
+    obj.faces.reserve(2 * size_t(side - 1) * (side - 1));
+    for (int j = 0; j + 1 < side; j++) {
+        for (int i = 0; i + 1 < side; i++) {
+            const int v = j * side + i;
+            obj.faces.emplace_back(v, v + side, v + 1);
+            obj.faces.emplace_back(v + 1, v + side, v + side + 1);
+        }
+    }
+}
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(VertNorm) * data.size(), &data.front(), GL_STATIC_DRAW);
+// Vertex normals summed face by face into the vertices on one thread, as before Mesh.
+std::vector<glm::vec3> referenceNormals(const Obj& obj, Mesh::Weighting weighting)
+{
+    std::vector<glm::vec3> sums(obj.vertices.size(), glm::vec3(0.0f));
+    for (const TriFace& face : obj.faces) {
+        const glm::vec3 p[3] = {obj.vertices[face[0]], obj.vertices[face[1]], obj.vertices[face[2]]};
+        const glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+        const float length = glm::length(n);
+        if (length == 0.0f) {
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            const glm::vec3 a = glm::normalize(p[(k + 1) % 3] - p[k]), b = glm::normalize(p[(k + 2) % 3] - p[k]);
+            const float weight = weighting == Mesh::Weighting::AREA ? 0.5f * length : std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f));
+            sums[face[k]] += weight * n / length;
+        }
+    }
+    for (glm::vec3& sum : sums) {
+        const float length = glm::length(sum);
+        sum = length > 0.0f ? sum / length : glm::vec3(0.0f);
+    }
+    return sums;
+}
 
-    // set vertex attribute pointers
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertNorm), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertNorm), (GLvoid*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
+void benchNormals(JobSystem& jobs)
+{
+    // a 10M triangle grid: the adjacency, then the normals with both weightings, checked
+    // against the serial sums
+    Obj grid;
+    makeGrid(grid, 2237);
+    Mesh mesh;
+    auto start = std::chrono::steady_clock::now();
+    mesh.Build(grid, jobs);
+    std::cout << "normals: " << grid.numTriangles() << " triangles, " << grid.numVertices() << " vertices, "
+              << jobs.Workers() << " workers, adjacency built in " << elapsedMs(start) << " ms" << std::endl;
+
+    for (Mesh::Weighting weighting : {Mesh::Weighting::AREA, Mesh::Weighting::ANGLE}) {
+        start = std::chrono::steady_clock::now();
+        mesh.ComputeNormals(jobs, weighting);
+        const double ms = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        const std::vector<glm::vec3> reference = referenceNormals(grid, weighting);
+        const double serialMs = elapsedMs(start);
+        float difference = 0.0f;
+        for (size_t v = 0; v < reference.size(); v++) {
+            difference = std::max(difference, glm::length(glm::vec3(mesh.VertexNormals()[v]) - reference[v]));
+        }
+        std::cout << "normals: " << (weighting == Mesh::Weighting::AREA ? "area" : "angle") << " weighted in " << ms
+                  << " ms, serial sums " << serialMs << " ms, max difference " << difference << std::endl;
+    }
+}
 
-    // unbind VBO & VAO
+// Packs 3 vertices with a position and a normal per face and uploads them, as the two
+// de-indexed buffers were before Mesh. Returns the bytes uploaded.
+GLsizeiptr uploadDeindexed(GLuint VBO, const Obj& obj, const std::vector<Vertex>& normals, bool perFace)
+{
+    std::vector<Vertex> data;
+    data.reserve(6 * obj.faces.size());
+    for (size_t f = 0; f < obj.faces.size(); f++) {
+        for (int k = 0; k < 3; k++) {
+            const int v = obj.faces[f][k];
+            data.push_back(obj.vertices[v]);
+            data.push_back(normals[perFace ? f : size_t(v)]);
+        }
+    }
+    const GLsizeiptr bytes = GLsizeiptr(data.size() * sizeof(Vertex));
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, bytes, data.data(), GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    return bytes;
+}
 
-    return int(data.size());
+void benchUpload(JobSystem& jobs)
+{
+    // the buffers of a 10M triangle grid: two de-indexed copies against the indexed mesh, and
+    // what a switch of the weighting uploads again
+    Obj grid;
+    makeGrid(grid, 2237);
+    Mesh mesh;
+    mesh.Build(grid, jobs);
+    mesh.ComputeNormals(jobs, Mesh::Weighting::AREA);
+    const double MB = 1.0 / (1 << 20);
+
+    GLuint VBOs[2];
+    glGenBuffers(2, VBOs);
+    auto start = std::chrono::steady_clock::now();
+    GLsizeiptr bytes = uploadDeindexed(VBOs[0], grid, mesh.VertexNormals(), false);
+    bytes += uploadDeindexed(VBOs[1], grid, mesh.FaceNormals(), true);
+    glFinish();
+    std::cout << "upload: " << grid.numTriangles() << " triangles, de-indexed " << bytes * MB << " MB in " << elapsedMs(start) << " ms" << std::endl;
+    start = std::chrono::steady_clock::now();
+    bytes = uploadDeindexed(VBOs[0], grid, mesh.VertexNormals(), false);
+    glFinish();
+    std::cout << "upload: de-indexed weighting switch " << bytes * MB << " MB in " << elapsedMs(start) << " ms" << std::endl;
+    glDeleteBuffers(2, VBOs);
+
+    mesh.SetupBuffers();
+    start = std::chrono::steady_clock::now();
+    mesh.Upload();
+    glFinish();
+    const double ms = elapsedMs(start);
+    bytes = GLsizeiptr(2 * grid.vertices.size() * sizeof(Vertex) + grid.faces.size() * sizeof(TriFace));
+    if (mesh.HasFaceBuffer()) {
+        bytes += GLsizeiptr(mesh.FaceNormals().size() * sizeof(Vertex));
+    }
+    std::cout << "upload: indexed " << bytes * MB << " MB in " << ms << " ms, face buffer " << (mesh.HasFaceBuffer() ? "used" : "too large") << std::endl;
+    start = std::chrono::steady_clock::now();
+    mesh.UploadVertexNormals();
+    glFinish();
+    std::cout << "upload: indexed weighting switch " << mesh.VertexNormals().size() * sizeof(Vertex) * MB << " MB in " << elapsedMs(start) << " ms" << std::endl;
+    mesh.ReleaseBuffers();
+}
+
+void benchVertexStage(JobSystem& jobs, const Shader& lightingShader)
+{
+    // a 10M vertex grid drawn with the rasterizer off, so only the vertex stage runs: the old
+    // shader that inverts the model matrix per vertex, then lighting in world and camera space
+    auto inverseShader = Shader::Create("materialinverse.vert", "material.frag");
+    if (inverseShader == nullptr) {
+        std::cerr << "Error creating Shader Program" << std::endl;
+        return;
+    }
+    Obj grid;
+    makeGrid(grid, 3163);
+    Mesh mesh;
+    mesh.Build(grid, jobs);
+    mesh.ComputeNormals(jobs, Mesh::Weighting::AREA);
+    mesh.SetupBuffers();
+    mesh.Upload();
+
+    const glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+    const glm::mat4 view = camera.ViewMatrix();
+    const glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom()), GLfloat(screenWidth) / GLfloat(screenHeight), 0.1f, 100.0f);
+    const char* const names[] = {"per-vertex inverse", "world space", "camera space"};
+    for (int variant = 0; variant < 3; variant++) {
+        if (variant == 0) {
+            inverseShader->Use();
+            glUniformMatrix4fv(glGetUniformLocation(inverseShader->Program(), "model"), 1, GL_FALSE, glm::value_ptr(model));
+            glUniformMatrix4fv(glGetUniformLocation(inverseShader->Program(), "view"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(glGetUniformLocation(inverseShader->Program(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        } else {
+            const bool inCamera = variant == 2;
+            const glm::mat4 lightingModel = inCamera ? view * model : model;
+            const glm::mat4 lightingProjection = inCamera ? projection : projection * view;
+            const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(lightingModel)));
+            lightingShader.Use();
+            glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program(), "lightingModel"), 1, GL_FALSE, glm::value_ptr(lightingModel));
+            glUniformMatrix4fv(glGetUniformLocation(lightingShader.Program(), "lightingProjection"), 1, GL_FALSE, glm::value_ptr(lightingProjection));
+            glUniformMatrix3fv(glGetUniformLocation(lightingShader.Program(), "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        }
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        const int frames = 3;
+        double ms = 0.0;
+        for (int f = 0; f <= frames; f++) {
+            glFinish();
+            const auto start = std::chrono::steady_clock::now();
+            mesh.Draw();
+            glFinish();
+            // the first frame only warms up
+            ms += f > 0 ? elapsedMs(start) : 0.0;
+        }
+        glDisable(GL_RASTERIZER_DISCARD);
+        std::cout << "vertex stage: " << names[variant] << ", " << grid.numVertices() << " vertices, "
+                  << ms / frames << " ms per draw" << std::endl;
+    }
+    mesh.ReleaseBuffers();
 }
@@ -22,13 +22,27 @@ struct Light {
 
 in vec3 FragPos;  
 in vec3 Normal;  
-flat in vec3 flatNormal;  
   
 uniform vec3 viewPos;
 uniform Material material;
 uniform Light light;
 
 uniform bool useFaceNormal;
+uniform bool useFaceBuffer;
+uniform samplerBuffer faceNormals;  // 3 floats per face, in model space
+uniform mat3 normalMatrix;         // model to lighting space, see material.vert
+
+// The normal of the face drawn, the triangles are drawn in the order of the faces so
+// gl_PrimitiveID is the face index. Without the buffer it comes from the screen-space
+// derivatives of the position, which lie in the plane of the triangle.
+vec3 faceNormal()
+{
+    if (useFaceBuffer) {
+        int base = 3 * gl_PrimitiveID;
+        return normalMatrix * vec3(texelFetch(faceNormals, base).r, texelFetch(faceNormals, base + 1).r, texelFetch(faceNormals, base + 2).r);
+    }
+    return cross(dFdx(FragPos), dFdy(FragPos));
+}
 
 void main()
 {
@@ -38,7 +52,7 @@ void main()
     // diffuse 
     vec3 norm;
     if (useFaceNormal) {
-        norm = normalize(flatNormal);
+        norm = normalize(faceNormal());
     } else {
         norm = normalize(Normal);
     }
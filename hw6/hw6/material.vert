@@ -9,16 +9,17 @@ layout (location = 1) in vec3 normal;
 
 out vec3 FragPos;
 out vec3 Normal;
-flat out vec3 flatNormal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// lighting is done in world space, or in camera space where the viewer is at the origin;
+// all matrices are combined once per frame on the CPU
+uniform mat4 lightingModel;         // model, or view * model in camera space
+uniform mat4 lightingProjection;    // projection * view, or projection in camera space
+uniform mat3 normalMatrix;          // inverse transpose of lightingModel
 
 void main()
 {
-    gl_Position = projection * view *  model * vec4(position, 1.0f);
-    FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;  
-    flatNormal = Normal;  
-} 
+    vec4 lightingPosition = lightingModel * vec4(position, 1.0f);
+    gl_Position = lightingProjection * lightingPosition;
+    FragPos = vec3(lightingPosition);
+    Normal = normalMatrix * normal;
+}
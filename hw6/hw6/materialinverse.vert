@@ -0,0 +1,25 @@
+/*
+ * GLSL Vertex Shader code for OpenGL version 3.3
+ *
+ * The vertex shader material.vert replaced, which builds the normal matrix and the matrix
+ * products for every vertex; only used by hw6 --bench to compare the two.
+ */
+
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view *  model * vec4(position, 1.0f);
+    FragPos = vec3(model * vec4(position, 1.0f));
+    Normal = mat3(transpose(inverse(model))) * normal;
+}
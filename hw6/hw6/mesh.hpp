@@ -0,0 +1,265 @@
+#ifndef CG_MESH_H_
+#define CG_MESH_H_
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "jobs.hpp"
+#include "obj.hpp"
+
+namespace cg
+{
+/* Normals of a triangle mesh: one unit normal per face and one per vertex, the vertex normal being
+ * the weighted average of the normals of the faces around it.
+ *
+ * The faces around every vertex are kept in compressed rows of corners (corner 3 * f + k is
+ * vertex k of face f), built in parallel: every corner takes a slot in the row of its vertex with
+ * an atomic counter, the rows are placed by a prefix sum of the counts, and the corners are written
+ * to their slots. Each vertex normal is then gathered from its own row, so no two threads ever add
+ * to the same normal. Rows are sorted, so the sums, and the normals, do not depend on the threads.
+ *
+ * On the GPU the vertices are drawn once, indexed by the faces: one buffer holds all positions,
+ * then all vertex normals, so switching the weighting uploads the normals only. The face normals
+ * go to a buffer texture of 3 floats per face, fetched in the fragment shader with gl_PrimitiveID.
+*/
+class Mesh
+{
+public:
+	enum class Weighting
+	{
+		AREA,       // faces count with their area
+		ANGLE,      // faces count with their angle at the vertex
+	};
+
+	static constexpr int GRAIN = 4096;  // faces or vertices per job
+
+	Mesh() : obj(nullptr), faceBuffer(false), VAO(0), VBO(0), EBO(0), faceTBO(0), faceTexture(0) { }
+
+	virtual ~Mesh() { }
+
+	/* Getters */
+	const std::vector<Vertex>& FaceNormals() const { return faceNormals; }
+	const std::vector<Vertex>& VertexNormals() const { return vertexNormals; }
+	// corners around vertex v: Corners()[CornerOffsets()[v] .. CornerOffsets()[v + 1])
+	const std::vector<int>& CornerOffsets() const { return cornerOffsets; }
+	const std::vector<int>& Corners() const { return corners; }
+	// whether the face normals fit in a buffer texture, see BindFaceNormals()
+	bool HasFaceBuffer() const { return faceBuffer; }
+
+	// Builds the vertex to face adjacency of the object, which must outlive the mesh.
+	void Build(const Obj& object, JobSystem& jobs)
+	{
+		obj = &object;
+		const int nv = obj->numVertices();
+		const int nf = obj->numTriangles();
+		const int nc = 3 * nf;
+
+		// counting pass, the count before the increment is the slot of the corner in its row
+		std::vector<std::atomic<int>> counts(nv);
+		std::vector<int> slots(nc);
+		jobs.ParallelFor(nv, GRAIN, [&](int begin, int end) {
+			for (int v = begin; v < end; v++) {
+				counts[v].store(0, std::memory_order_relaxed);
+			}
+		});
+		jobs.ParallelFor(nf, GRAIN, [&](int begin, int end) {
+			for (int f = begin; f < end; f++) {
+				for (int k = 0; k < 3; k++) {
+					slots[3 * f + k] = counts[obj->faces[f][k]].fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		});
+
+		// exclusive prefix sum of the counts: sum every chunk, scan the sums, then the chunks
+		cornerOffsets.resize(size_t(nv) + 1);
+		const int numChunks = std::max(1, std::min(4 * jobs.Workers(), nv / GRAIN));
+		const int chunkSize = (nv + numChunks - 1) / numChunks;
+		std::vector<int> chunkOffsets(size_t(numChunks) + 1, 0);
+		jobs.ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				const int last = std::min(nv, (k + 1) * chunkSize);
+				int sum = 0;
+				for (int v = k * chunkSize; v < last; v++) {
+					sum += counts[v].load(std::memory_order_relaxed);
+				}
+				chunkOffsets[k + 1] = sum;
+			}
+		});
+		for (int k = 0; k < numChunks; k++) {
+			chunkOffsets[k + 1] += chunkOffsets[k];
+		}
+		jobs.ParallelFor(numChunks, 1, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				const int last = std::min(nv, (k + 1) * chunkSize);
+				int offset = chunkOffsets[k];
+				for (int v = k * chunkSize; v < last; v++) {
+					cornerOffsets[v] = offset;
+					offset += counts[v].load(std::memory_order_relaxed);
+				}
+			}
+		});
+		cornerOffsets[nv] = nc;
+
+		// every corner has its own slot, nothing is shared
+		corners.resize(nc);
+		jobs.ParallelFor(nf, GRAIN, [&](int begin, int end) {
+			for (int f = begin; f < end; f++) {
+				for (int k = 0; k < 3; k++) {
+					corners[cornerOffsets[obj->faces[f][k]] + slots[3 * f + k]] = 3 * f + k;
+				}
+			}
+		});
+		jobs.ParallelFor(nv, GRAIN, [&](int begin, int end) {
+			for (int v = begin; v < end; v++) {
+				std::sort(corners.begin() + cornerOffsets[v], corners.begin() + cornerOffsets[v + 1]);
+			}
+		});
+	}
+
+	// Computes the face normals, then the vertex normals with this weighting. Build() first.
+	void ComputeNormals(JobSystem& jobs, Weighting weighting)
+	{
+		const int nf = obj->numTriangles();
+		const int nv = obj->numVertices();
+
+		// the weight of the face at each of its corners
+		faceNormals.resize(nf);
+		weights.resize(3 * size_t(nf));
+		jobs.ParallelFor(nf, GRAIN, [&](int begin, int end) {
+			for (int f = begin; f < end; f++) {
+				const TriFace& face = obj->faces[f];
+				const glm::vec3 p[3] = {obj->vertices[face[0]], obj->vertices[face[1]], obj->vertices[face[2]]};
+				const glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+				const float length = glm::length(n);
+				// degenerate faces have no direction and no weight
+				faceNormals[f] = Vertex(length > 0.0f ? n / length : glm::vec3(0.0f));
+
+				float* w = &weights[3 * size_t(f)];
+				if (weighting == Weighting::AREA || length == 0.0f) {
+					w[0] = w[1] = w[2] = 0.5f * length;
+				} else {
+					// the angles of a triangle add up to pi, so the third one needs no acos
+					const glm::vec3 e0 = glm::normalize(p[1] - p[0]);
+					const glm::vec3 e1 = glm::normalize(p[2] - p[1]);
+					const glm::vec3 e2 = glm::normalize(p[0] - p[2]);
+					w[0] = std::acos(glm::clamp(-glm::dot(e2, e0), -1.0f, 1.0f));
+					w[1] = std::acos(glm::clamp(-glm::dot(e0, e1), -1.0f, 1.0f));
+					w[2] = std::max(0.0f, glm::pi<float>() - w[0] - w[1]);
+				}
+			}
+		});
+
+		vertexNormals.resize(nv);
+		jobs.ParallelFor(nv, GRAIN, [&](int begin, int end) {
+			for (int v = begin; v < end; v++) {
+				glm::vec3 sum(0.0f);
+				for (int k = cornerOffsets[v]; k < cornerOffsets[v + 1]; k++) {
+					const int c = corners[k];
+					sum += weights[c] * glm::vec3(faceNormals[c / 3]);
+				}
+				// vertices of degenerate faces only are left without a normal
+				const float length = glm::length(sum);
+				vertexNormals[v] = Vertex(length > 0.0f ? sum / length : glm::vec3(0.0f));
+			}
+		});
+	}
+
+	/* GL objects, vertex attributes: 0 position, 1 normal */
+	void SetupBuffers()
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glGenBuffers(1, &faceTBO);
+		glGenTextures(1, &faceTexture);
+	}
+
+	void ReleaseBuffers()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteBuffers(1, &faceTBO);
+		glDeleteTextures(1, &faceTexture);
+		VAO = VBO = EBO = faceTBO = faceTexture = 0;
+		faceBuffer = false;
+	}
+
+	// Uploads the vertices, the faces and all normals. ComputeNormals() first.
+	void Upload()
+	{
+		static_assert(sizeof(TriFace) == 3 * sizeof(GLuint), "faces are uploaded as indices");
+		static_assert(sizeof(Vertex) == 3 * sizeof(GLfloat), "vertices are uploaded as they are");
+		const GLsizeiptr bytes = GLsizeiptr(obj->vertices.size() * sizeof(Vertex));
+
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, 2 * bytes, nullptr, GL_STATIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, obj->vertices.data());
+		glBufferSubData(GL_ARRAY_BUFFER, bytes, bytes, vertexNormals.data());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, obj->faces.size() * sizeof(TriFace), obj->faces.data(), GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)bytes);
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// OpenGL 3.3 only guarantees 65536 texels, large meshes fall back to derivatives
+		GLint maxTexels = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		faceBuffer = 3 * faceNormals.size() <= size_t(maxTexels);
+		glBindBuffer(GL_TEXTURE_BUFFER, faceTBO);
+		glBufferData(GL_TEXTURE_BUFFER, faceBuffer ? faceNormals.size() * sizeof(Vertex) : 0, faceNormals.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_BUFFER, faceTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, faceTBO);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// Uploads the vertex normals again, after ComputeNormals() with another weighting.
+	void UploadVertexNormals()
+	{
+		const GLsizeiptr bytes = GLsizeiptr(vertexNormals.size() * sizeof(Vertex));
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferSubData(GL_ARRAY_BUFFER, bytes, bytes, vertexNormals.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void BindFaceNormals(GLenum unit) const
+	{
+		glActiveTexture(unit);
+		glBindTexture(GL_TEXTURE_BUFFER, faceTexture);
+	}
+
+	void Draw() const
+	{
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, GLsizei(3 * obj->faces.size()), GL_UNSIGNED_INT, nullptr);
+		glBindVertexArray(0);
+	}
+
+private:
+	const Obj* obj;
+	bool faceBuffer;
+
+	std::vector<Vertex> faceNormals;        // per face
+	std::vector<Vertex> vertexNormals;      // per vertex
+	std::vector<float> weights;             // per corner
+	std::vector<int> cornerOffsets, corners;
+
+	GLuint VAO, VBO, EBO;
+	GLuint faceTBO, faceTexture;
+};
+
+} /* namespace cg */
+
+#endif /* CG_MESH_H_ */
@@ -75,6 +75,8 @@ std::istream& operator>>(std::istream& in, Obj& obj)
 		try {
 			std::getline(in, buf);
 			std::istringstream iss(buf);
+			// an empty line reads no command, it must not repeat the one of the line before
+			cmd.clear();
 			iss >> cmd;
 
 			if (cmd.size() == 0 || cmd[0] == '#' || cmd[0] == '\n') {
@@ -88,7 +90,10 @@ std::istream& operator>>(std::istream& in, Obj& obj)
 			}
 			else if (cmd.compare("f") == 0) {
 				int f[3];
-				iss >> f[0] >> f[1] >> f[2];
+				if (!(iss >> f[0] >> f[1] >> f[2])) {
+					std::cerr << "Warning: skipping face line '" << buf << "'" << std::endl;
+					continue;
+				}
 				obj.faces.emplace_back(f[0] - 1, f[1] - 1, f[2] - 1);
 			}
 			else {